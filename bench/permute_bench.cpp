@@ -0,0 +1,108 @@
+/******************************************************************************
+
+Copyright (c) 2022 Elijah Coleman
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+******************************************************************************/
+//=============================================================================
+// Throughput of the KECCAK-f[1600] kernels, in nanoseconds per permuted
+// state: keccak_f_fast() on one state, keccak_f_x2() on two and
+// keccak_f_mb<N> on N. Every kernel is called through a non-inlined wrapper
+// (as from the hashing loops); the best of <reps> runs of <count> calls is
+// reported, which filters out the noise of the other processes.
+//   permute_bench [-count calls] [-reps runs]
+
+#include "../sha3_ec.h"
+#include "../sha3_mb.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+using Clock = std::chrono::steady_clock;
+
+//-----------------------------------------------------------------------------
+__attribute__((noinline)) static void permute_1(chash::int_t (&st)[chash::kStateSize][1])
+{
+    chash::keccak_f_fast(&st[0][0]);
+}
+
+__attribute__((noinline)) static void permute_x2(chash::int_t (&st)[chash::kStateSize][2])
+{
+    chash::keccak_f_x2(st);
+}
+
+template<size_t N>
+__attribute__((noinline)) static void permute_mb(chash::int_t (&st)[chash::kStateSize][N])
+{
+    chash::keccak_f_mb(st);
+}
+
+//-----------------------------------------------------------------------------
+template<size_t N, typename Func>
+static double measure(Func permute, unsigned count, unsigned reps,
+                      chash::int_t& check)
+{   // Best time of <reps> runs, ns per state
+    chash::int_t st[chash::kStateSize][N] = {};
+    double best = 1e30;
+    for (unsigned r = 0; r < reps; r++) {
+        auto start = Clock::now();
+        for (unsigned i = 0; i < count; i++)
+            permute(st);
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        best = std::min(best, ns / count / N);
+    }
+    for (size_t k = 0; k < N; k++)
+        check ^= st[0][k];                  // keeps the results alive
+    return (best);
+} // end measure(...)
+
+//=============================================================================
+int main(int argc, const char* argv[])
+{
+    unsigned count = 20000, reps = 50;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "-count") == 0)
+            count = static_cast<unsigned>(std::stoul(argv[i + 1]));
+        else if (std::strcmp(argv[i], "-reps") == 0)
+            reps = static_cast<unsigned>(std::stoul(argv[i + 1]));
+    }
+    std::cout << "permute_bench: best of " << reps << " x " << count
+              << " calls, ns per state\n";
+
+    chash::int_t check = 0;
+    double one = measure<1>(permute_1, count, reps, check);
+    auto report = [one](const char* name, double ns) {
+        std::cout << "  " << std::left << std::setw(24) << name << std::right
+                  << std::fixed << std::setprecision(1) << std::setw(8) << ns
+                  << "  x" << std::setprecision(2) << one / ns << "\n";
+    };
+    report("keccak_f_fast", one);
+    report("keccak_f_x2", measure<2>(permute_x2, count, reps, check));
+    report("keccak_f_mb<2> (generic)", measure<2>(permute_mb<2>, count, reps, check));
+    report("keccak_f_mb<4>", measure<4>(permute_mb<4>, count, reps, check));
+    report("keccak_f_mb<8>", measure<8>(permute_mb<8>, count, reps, check));
+    std::cout << "  (check " << std::hex << check << ")\n";
+    return (0);
+} // end main()
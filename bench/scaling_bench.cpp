@@ -0,0 +1,462 @@
+/******************************************************************************
+
+Copyright (c) 2022 Elijah Coleman
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+******************************************************************************/
+//=============================================================================
+// Multicore scaling benchmark of the parallel hashing paths.
+// For each scenario, working set and message size the thread count is swept
+// from 1 to <threads> (powers of two and the maximum); every configuration
+// runs for <seconds> and reports the throughput, the parallel efficiency
+// (throughput / (threads * single-thread throughput)) and the latency
+// percentiles of one operation, as JSON.
+// Scenarios:
+//   iuf        - a SHA3_IUF per thread (init/update_fast/finalize)
+//   pool       - hashers leased from hasher_pool() per message
+//   ctx        - KeccakCtx of one contiguous array (neighbouring threads
+//                share cache lines: false sharing)
+//   ctx-local  - KeccakCtx from an arena per thread
+//   batch      - hash_many() over 64 messages per operation
+//   merkle     - MerkleTree(threads).build() of the working set
+//   files      - walk and hash a directory tree ('-dir', as sha3md -r -j)
+// Working sets: "cache" - 256 KB per thread, "memory" - one '-mem' MB buffer
+// shared by all of the threads (memory bandwidth bound).
+
+#include "../sha3_ec.h"
+#include "../sha3_mb.h"
+#include "../sha3_pool.h"
+#include "../sha3_ctx.h"
+#include "../sha3_merkle.h"
+#include "../sha3md_walk.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+//-----------------------------------------------------------------------------
+// Latency histogram: 8 sub-buckets per power of two (12.5% resolution), no
+// allocation on the measured path
+class Histogram
+{
+public:
+    static const int kBuckets = 64 * 8;
+
+    void add(uint64_t ns) noexcept
+    {
+        int b = 0;
+        if (ns >= 8) {
+            int log2 = 63 - __builtin_clzll(ns);
+            b = (log2 - 2) * 8 + static_cast<int>((ns >> (log2 - 3)) & 7);
+        }
+        else
+            b = static_cast<int>(ns);
+        count_[std::min(b, kBuckets - 1)]++;
+        max_ = std::max(max_, ns);
+        total_++;
+    }
+    void merge(const Histogram& other) noexcept
+    {
+        for (int i = 0; i < kBuckets; i++)
+            count_[i] += other.count_[i];
+        max_ = std::max(max_, other.max_);
+        total_ += other.total_;
+    }
+    uint64_t percentile(double p) const noexcept
+    {   // upper bound of the bucket holding the <p> quantile
+        uint64_t rank = static_cast<uint64_t>(p * total_), seen = 0;
+        for (int i = 0; i < kBuckets; i++) {
+            seen += count_[i];
+            if (seen > rank)
+                return (std::min(upper(i), max_));
+        }
+        return (max_);
+    }
+    uint64_t total() const noexcept  {  return (total_);  }
+    uint64_t max() const noexcept  {  return (max_);  }
+
+private:
+    static uint64_t upper(int b) noexcept
+    {
+        if (b < 8)
+            return (b + 1);
+        int log2 = b / 8 + 2;
+        return ((uint64_t(8 + b % 8 + 1) << (log2 - 3)) - 1);
+    }
+
+    uint64_t count_[kBuckets] = {};
+    uint64_t max_ = 0;
+    uint64_t total_ = 0;
+}; // end class Histogram
+
+//------ One measured configuration ------
+struct Result {
+    std::string scenario, working_set;
+    size_t message_size = 0;
+    unsigned threads = 0;
+    uint64_t ops = 0, bytes = 0;
+    double seconds = 0;
+    Histogram latency;
+};
+
+//------ Benchmark settings ------
+struct Settings {
+    unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<size_t> sizes = { 64, 1024, 16384, 1 << 20 };
+    std::vector<std::string> scenarios = { "iuf", "pool", "ctx", "ctx-local",
+                                           "batch", "merkle" };
+    std::vector<std::string> working_sets = { "cache", "memory" };
+    size_t memory_mb = 256;
+    double seconds = 0.5;
+    std::string dir;                // 'files' scenario
+    std::string out;                // JSON file (default - stdout)
+};
+
+static const size_t kCacheSet = 256 << 10;  // per thread
+static const size_t kBatch = 64;            // messages per hash_many()
+
+//-----------------------------------------------------------------------------
+template<class Op>
+void run_threads(Result& res, unsigned threads, double seconds, Op op)
+{   // op(thread id, iteration) -> bytes hashed by one operation. The threads
+    // start together and run until the time is up.
+    std::vector<Histogram> hist(threads);
+    std::vector<uint64_t> ops(threads, 0), bytes(threads, 0);
+    std::atomic<bool> stop{false};
+    std::atomic<unsigned> ready{0};
+    auto worker = [&](unsigned id) {
+        ready++;
+        while (ready.load() < threads)
+            std::this_thread::yield();
+        for (uint64_t i = 0; !stop.load(std::memory_order_relaxed); i++) {
+            auto start = Clock::now();
+            bytes[id] += op(id, i);
+            hist[id].add(static_cast<uint64_t>(std::chrono::duration_cast<
+                    std::chrono::nanoseconds>(Clock::now() - start).count()));
+            ops[id]++;
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; t++)
+        pool.emplace_back(worker, t);
+    auto start = Clock::now();
+    std::thread timer([&]() {
+        while (ready.load() < threads)
+            std::this_thread::yield();
+        std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+        stop = true;
+    });
+    worker(0);
+    for (auto& t : pool)
+        t.join();
+    timer.join();
+    res.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    for (unsigned t = 0; t < threads; t++) {
+        res.latency.merge(hist[t]);
+        res.ops += ops[t];
+        res.bytes += bytes[t];
+    }
+} // end run_threads(...)
+
+//-----------------------------------------------------------------------------
+Result run_config(const std::string& scenario, const std::string& ws,
+                  size_t size, unsigned threads, const Settings& set,
+                  const std::vector<char>& memory)
+{
+    Result res;
+    res.scenario = scenario;
+    res.working_set = ws;
+    res.message_size = size;
+    res.threads = threads;
+
+    // Each thread walks its own region of the working set
+    const bool shared = ("memory" == ws);
+    std::vector<std::vector<char>> local;
+    if (!shared)
+        for (unsigned t = 0; t < threads; t++)
+            local.emplace_back(std::max(kCacheSet, size), static_cast<char>(t + 1));
+    const size_t region = shared ? memory.size() / threads : local[0].size();
+    const size_t slots = std::max<size_t>(1, region / size);
+    auto message = [&](unsigned id, uint64_t i) -> const char* {
+        const char* base = shared ? memory.data() + id * region : local[id].data();
+        return (base + (i % slots) * size);
+    };
+
+    if ("iuf" == scenario) {
+        std::vector<std::unique_ptr<chash::SHA3_IUF>> hashers;
+        for (unsigned t = 0; t < threads; t++)
+            hashers.push_back(std::make_unique<chash::SHA3_IUF>(chash::kSHA3_256));
+        run_threads(res, threads, set.seconds, [&](unsigned id, uint64_t i) {
+            chash::SHA3_IUF& h = *hashers[id];
+            h.init();
+            h.update_fast(message(id, i), size);
+            return (h.finalize().empty() ? 0 : size);
+        });
+    }
+    else if ("pool" == scenario) {
+        run_threads(res, threads, set.seconds, [&](unsigned id, uint64_t i) {
+            auto lease = chash::hasher_pool(chash::kSHA3_256).acquire();
+            lease->update_fast(message(id, i), size);
+            return (lease->finalize().empty() ? 0 : size);
+        });
+    }
+    else if ("ctx" == scenario or "ctx-local" == scenario) {
+        chash::CtxArena arena;
+        std::vector<std::unique_ptr<chash::CtxArena>> arenas;
+        std::vector<chash::KeccakCtx*> ctx(threads);
+        if ("ctx" == scenario) {
+            chash::KeccakCtx* array = arena.allocate_array(threads, chash::kSHA3_256);
+            for (unsigned t = 0; t < threads; t++)
+                ctx[t] = array + t;
+        }
+        else
+            for (unsigned t = 0; t < threads; t++) {
+                arenas.push_back(std::make_unique<chash::CtxArena>(1));
+                ctx[t] = arenas.back()->allocate(chash::kSHA3_256);
+            }
+        run_threads(res, threads, set.seconds, [&](unsigned id, uint64_t i) {
+            chash::byte digest[32];
+            ctx[id]->init();
+            ctx[id]->update(message(id, i), size);
+            ctx[id]->finalize(digest);
+            return (size);
+        });
+    }
+    else if ("batch" == scenario) {
+        run_threads(res, threads, set.seconds, [&](unsigned id, uint64_t i) {
+            const char* msgs[kBatch];
+            chash::size_t lens[kBatch];
+            chash::byte out[kBatch][32];
+            chash::byte* digests[kBatch];
+            for (size_t k = 0; k < kBatch; k++) {
+                msgs[k] = message(id, i * kBatch + k);
+                lens[k] = size;
+                digests[k] = out[k];
+            }
+            chash::hash_many(chash::kSHA3_256, msgs, lens, digests, kBatch);
+            return (kBatch * size);
+        });
+    }
+    else if ("merkle" == scenario) {
+        // One builder; the tree hashes the leaves on <threads> threads
+        const char* base = shared ? memory.data() : local[0].data();
+        const size_t span = shared ? memory.size() : local[0].size();
+        const size_t count = std::min<size_t>(65536, std::max<size_t>(1,
+                (shared ? memory.size() : kCacheSet * threads) / size));
+        std::vector<std::string> leaves;
+        for (size_t k = 0; k < count; k++)
+            leaves.emplace_back(base + (k * size) % (span - size + 1), size);
+        chash::MerkleTree tree(threads);
+        run_threads(res, 1, set.seconds, [&](unsigned, uint64_t) {
+            tree.build(leaves);
+            return (leaves.size() * size);
+        });
+        res.threads = threads;
+    }
+    return (res);
+} // end run_config(...)
+
+//-----------------------------------------------------------------------------
+Result run_files(const std::string& dir, unsigned threads)
+{   // Walk and hash a tree once (cold or warm page cache - as it is)
+    Result res;
+    res.scenario = "files";
+    res.working_set = dir;
+    res.threads = threads;
+    auto start = Clock::now();
+    std::vector<std::string> errors;
+    std::vector<sha3md::FileEntry> files = sha3md::walk_tree(dir, threads, errors);
+    std::vector<Histogram> hist(threads);
+    std::vector<uint64_t> bytes(threads, 0);
+    std::atomic<size_t> next{0};
+    auto worker = [&](unsigned id) {
+        chash::SHA3_IUF h(chash::kSHA3_256);
+        std::vector<char> buf(136 * 4096);
+        for (size_t i; (i = next++) < files.size(); ) {
+            auto t0 = Clock::now();
+            std::ifstream is(files[i].path, std::ios_base::binary);
+            h.init();
+            while (is.read(buf.data(), buf.size()) or is.gcount() > 0) {
+                h.update_fast(buf.data(), is.gcount());
+                bytes[id] += is.gcount();
+            }
+            h.finalize();
+            hist[id].add(static_cast<uint64_t>(std::chrono::duration_cast<
+                    std::chrono::nanoseconds>(Clock::now() - t0).count()));
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; t++)
+        pool.emplace_back(worker, t);
+    worker(0);
+    for (auto& t : pool)
+        t.join();
+    res.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    for (unsigned t = 0; t < threads; t++) {
+        res.latency.merge(hist[t]);
+        res.bytes += bytes[t];
+    }
+    res.ops = files.size();
+    return (res);
+} // end run_files(...)
+
+//-----------------------------------------------------------------------------
+std::string json_string(const std::string& str)
+{
+    std::string res = "\"";
+    for (char c : str) {
+        if ('"' == c or '\\' == c)
+            res.push_back('\\');
+        if (static_cast<unsigned char>(c) >= 0x20)
+            res.push_back(c);
+    }
+    return (res + "\"");
+} // end json_string(...)
+
+//-----------------------------------------------------------------------------
+void print_json(std::ostream& os, const Settings& set, const std::vector<Result>& results)
+{   // The efficiency is relative to the 1-thread run of the same configuration
+    os << std::fixed << std::setprecision(3);
+    os << "{\n  \"hardware_threads\": " << std::thread::hardware_concurrency()
+       << ",\n  \"max_threads\": " << set.max_threads
+       << ",\n  \"backend\": " << json_string(chash::backend_name(chash::best_backend()))
+       << ",\n  \"seconds_per_config\": " << set.seconds
+       << ",\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        double mbps = r.seconds > 0 ? r.bytes / r.seconds / 1e6 : 0;
+        double base = mbps;
+        for (const Result& b : results)
+            if (1 == b.threads and b.scenario == r.scenario and b.working_set == r.working_set
+                    and b.message_size == r.message_size and b.seconds > 0)
+                base = b.bytes / b.seconds / 1e6;
+        os << (i ? ",\n" : "\n") << "    {\"scenario\": " << json_string(r.scenario)
+           << ", \"working_set\": " << json_string(r.working_set)
+           << ", \"message_size\": " << r.message_size
+           << ", \"threads\": " << r.threads
+           << ", \"ops\": " << r.ops
+           << ", \"seconds\": " << r.seconds
+           << ", \"mb_per_s\": " << mbps
+           << ", \"ops_per_s\": " << (r.seconds > 0 ? r.ops / r.seconds : 0)
+           << ", \"efficiency\": " << (base > 0 ? mbps / (r.threads * base) : 0)
+           << ", \"latency_ns\": {\"p50\": " << r.latency.percentile(0.5)
+           << ", \"p90\": " << r.latency.percentile(0.9)
+           << ", \"p99\": " << r.latency.percentile(0.99)
+           << ", \"p999\": " << r.latency.percentile(0.999)
+           << ", \"max\": " << r.latency.max() << "}}";
+    }
+    os << "\n  ]\n}\n";
+} // end print_json(...)
+
+//-----------------------------------------------------------------------------
+std::vector<std::string> split_list(const std::string& list)
+{
+    std::vector<std::string> res;
+    std::stringstream ss(list);
+    for (std::string item; std::getline(ss, item, ','); )
+        if (!item.empty())
+            res.push_back(item);
+    return (res);
+} // end split_list(...)
+
+//=============================================================================
+int main(int argc, const char* argv[])
+{
+    Settings set;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "-threads") == 0)
+            set.max_threads = std::max(1u, static_cast<unsigned>(std::stoul(argv[i + 1])));
+        else if (std::strcmp(argv[i], "-sizes") == 0) {
+            set.sizes.clear();
+            for (const auto& s : split_list(argv[i + 1]))
+                set.sizes.push_back(std::max<size_t>(1, std::stoul(s)));
+        }
+        else if (std::strcmp(argv[i], "-scenarios") == 0)
+            set.scenarios = split_list(argv[i + 1]);
+        else if (std::strcmp(argv[i], "-ws") == 0)
+            set.working_sets = split_list(argv[i + 1]);
+        else if (std::strcmp(argv[i], "-mem") == 0)
+            set.memory_mb = std::max<size_t>(1, std::stoul(argv[i + 1]));
+        else if (std::strcmp(argv[i], "-seconds") == 0)
+            set.seconds = std::stod(argv[i + 1]);
+        else if (std::strcmp(argv[i], "-dir") == 0)
+            set.dir = argv[i + 1];
+        else if (std::strcmp(argv[i], "-out") == 0)
+            set.out = argv[i + 1];
+        else {
+            std::cerr << "Usage: scaling_bench [-threads N] [-sizes 64,1024,...]"
+                      << " [-scenarios iuf,pool,ctx,ctx-local,batch,merkle]"
+                      << " [-ws cache,memory] [-mem MB] [-seconds S] [-dir tree]"
+                      << " [-out file.json]\n";
+            return (1);
+        }
+    }
+    std::vector<unsigned> counts;
+    for (unsigned t = 1; t < set.max_threads; t *= 2)
+        counts.push_back(t);
+    counts.push_back(set.max_threads);
+
+    std::vector<char> memory;
+    if (std::find(set.working_sets.begin(), set.working_sets.end(), "memory")
+            != set.working_sets.end()) {
+        memory.resize(set.memory_mb << 20);
+        for (size_t i = 0; i < memory.size(); i += 4096)  // touch the pages
+            memory[i] = static_cast<char>(i >> 12);
+    }
+
+    std::vector<Result> results;
+    for (const auto& scenario : set.scenarios)
+        for (const auto& ws : set.working_sets)
+            for (size_t size : set.sizes) {
+                if ("memory" == ws and size * set.max_threads > memory.size())
+                    continue;               // a message per thread must fit
+                for (unsigned t : counts) {
+                    std::cerr << scenario << " " << ws << " " << size << " B, "
+                              << t << " threads\n";
+                    results.push_back(run_config(scenario, ws, size, t, set, memory));
+                }
+            }
+    if (!set.dir.empty())
+        for (unsigned t : counts) {
+            std::cerr << "files " << set.dir << ", " << t << " threads\n";
+            results.push_back(run_files(set.dir, t));
+        }
+
+    if (set.out.empty())
+        print_json(std::cout, set, results);
+    else {
+        std::ofstream os(set.out);
+        print_json(os, set, results);
+    }
+    return (0);
+} // end main(...)
@@ -0,0 +1,105 @@
+/******************************************************************************
+
+Copyright (c) 2022 Elijah Coleman
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+******************************************************************************/
+//=============================================================================
+// Load generator for sha3d: <clients> threads, each with its own connection,
+// send <requests> hash requests of <size> bytes; reports the throughput, the
+// client-side latency percentiles and the statistics of the daemon.
+
+#include "../sha3_ec.h"
+#include "../sha3d_client.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+//=============================================================================
+int main(int argc, const char* argv[])
+{
+    std::string path = sha3d::kDefaultSocket;
+    unsigned clients = 8, requests = 10000;
+    size_t size = 64;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "-socket") == 0)
+            path = argv[i + 1];
+        else if (std::strcmp(argv[i], "-clients") == 0)
+            clients = static_cast<unsigned>(std::stoul(argv[i + 1]));
+        else if (std::strcmp(argv[i], "-requests") == 0)
+            requests = static_cast<unsigned>(std::stoul(argv[i + 1]));
+        else if (std::strcmp(argv[i], "-size") == 0)
+            size = std::stoul(argv[i + 1]);
+    }
+    std::cout << "sha3d_bench: " << clients << " clients x " << requests
+              << " requests x " << size << " bytes (SHA3-256)\n";
+
+    std::vector<std::vector<double>> latency(clients);
+    std::vector<int> errors(clients, 0);
+    auto client = [&](unsigned id) {
+        sha3d::HashClient conn(path);
+        std::string msg(size, static_cast<char>('a' + id % 26));
+        chash::SHA3_IUF ref(chash::kSHA3_256);
+        std::vector<chash::byte> expected = ref.get_digest(msg, msg.size() * 8);
+        std::vector<chash::byte> digest;
+        for (unsigned r = 0; r < requests; r++) {
+            auto start = std::chrono::steady_clock::now();
+            if (!conn.hash(sha3d::kSHA3_256, msg.data(), msg.size(), digest)
+                    or digest != expected) {
+                errors[id]++;
+                return;
+            }
+            latency[id].push_back(std::chrono::duration<double, std::micro>(
+                                  std::chrono::steady_clock::now() - start).count());
+        }
+    };
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (unsigned i = 0; i < clients; i++)
+        pool.emplace_back(client, i);
+    for (auto& t : pool)
+        t.join();
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<double> all;
+    for (const auto& l : latency)
+        all.insert(all.end(), l.begin(), l.end());
+    std::sort(all.begin(), all.end());
+    auto pct = [&all](double p) {
+        return (all.empty() ? 0.0 : all[static_cast<size_t>(p * (all.size() - 1))]);
+    };
+    int failed = 0;
+    for (int e : errors)
+        failed += e;
+    std::cout << "  requests/s: " << all.size() / sec
+              << "\n  MB/s:       " << all.size() * size / sec / 1e6
+              << "\n  latency us: p50 " << pct(0.5) << ", p90 " << pct(0.9)
+              << ", p99 " << pct(0.99)
+              << "\n  errors:     " << failed << "\n";
+    sha3d::HashClient conn(path);
+    std::cout << "daemon statistics:\n" << conn.stats();
+    return (failed ? 1 : 0);
+} // end main(...)
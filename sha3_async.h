@@ -0,0 +1,350 @@
+/******************************************************************************
+
+Copyright (c) 2022 Elijah Coleman
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef SHA3_ASYNC_H_
+#define SHA3_ASYNC_H_
+
+//-----------------------------------------------------------------------------
+// Asynchronous hashing with C++20 coroutines.
+//   co_await hasher.update(data, size);   // large chunks run on a worker
+//                                         // pool, small ones - inline
+//   auto op = source.read(buf, size);     // starts reading immediately
+//   ssize_t n = co_await op;
+// A coroutine suspended on a worker operation is resumed on the worker
+// thread which completed the operation.
+// Requires C++20 and linking with the threads library.
+
+#include "sha3_ec.h"
+
+#if __cplusplus >= 202002L
+
+#include <coroutine>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <system_error>
+#include <unistd.h>
+#endif
+
+namespace chash     // "cryptographic hash"
+{
+//====== Simple pool of worker threads ======
+class WorkerPool
+{
+public:
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    explicit WorkerPool(unsigned threads = 0)
+    {
+        if (!threads)
+            threads = std::max(2u, std::thread::hardware_concurrency());
+        for (unsigned i = 0; i < threads; i++)
+            workers_.emplace_back([this] {  run();  });
+    }
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        for (auto& thr : workers_)
+            thr.join();
+    }
+
+    void post(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            jobs_.push_back(std::move(job));
+        }
+        cv_.notify_one();
+    }
+
+private:
+    void run()
+    {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                cv_.wait(lock, [this] {  return (stop_ or !jobs_.empty());  });
+                if (jobs_.empty())
+                    return;
+                job = std::move(jobs_.front());
+                jobs_.pop_front();
+            }
+            job();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> jobs_;
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+}; // end for class WorkerPool
+
+//====== Lazy coroutine task ======
+template<typename T>
+class Task
+{
+public:
+    struct promise_type {
+        std::optional<T> value;
+        std::exception_ptr error;
+        std::coroutine_handle<> continuation;
+        std::mutex mtx;                 // for the blocking get()
+        std::condition_variable cv;
+        bool done = false;
+
+        Task get_return_object()
+        {  return (Task(std::coroutine_handle<promise_type>::from_promise(*this)));  }
+        std::suspend_always initial_suspend() noexcept  {  return {};  }
+        struct FinalAwaiter {
+            bool await_ready() noexcept  {  return (false);  }
+            std::coroutine_handle<> await_suspend(
+                std::coroutine_handle<promise_type> h) noexcept
+            {   // resume the awaiting coroutine or wake up get()
+                promise_type& p = h.promise();
+                if (p.continuation)
+                    return (p.continuation);
+                // notify under the lock: get() may destroy the task as
+                // soon as it sees <done>
+                std::lock_guard<std::mutex> lock(p.mtx);
+                p.done = true;
+                p.cv.notify_all();
+                return (std::noop_coroutine());
+            }
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept  {  return {};  }
+        void return_value(T val)  {  value = std::move(val);  }
+        void unhandled_exception()  {  error = std::current_exception();  }
+    };
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+    ~Task()
+    {
+        if (handle_)
+            handle_.destroy();
+    }
+
+    //------ co_await task (from another coroutine) ------
+    bool await_ready() const noexcept  {  return (false);  }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        handle_.promise().continuation = awaiting;
+        return (handle_);
+    }
+    T await_resume()
+    {
+        promise_type& p = handle_.promise();
+        if (p.error)
+            std::rethrow_exception(p.error);
+        return (std::move(*p.value));
+    }
+
+    //------ Start the task and block until it completes ------
+    T get()
+    {
+        promise_type& p = handle_.promise();
+        handle_.resume();
+        std::unique_lock<std::mutex> lock(p.mtx);
+        p.cv.wait(lock, [&p] {  return (p.done);  });
+        return (await_resume());
+    }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> h) : handle_(h) {}
+    std::coroutine_handle<promise_type> handle_;
+}; // end for class Task
+
+//====== Awaitable wrapper of IUFKeccak ======
+class AsyncHasher
+{
+public:
+    static const size_t kInlineLimit = 64 * 1024;   // bytes hashed inline
+
+    AsyncHasher(IUFKeccak& hasher, WorkerPool& pool,
+                size_t inline_limit = kInlineLimit)
+    :   hasher_(hasher), pool_(pool), inline_limit_(inline_limit)
+    {}
+
+    struct UpdateAwaiter {
+        AsyncHasher& owner;
+        const char* data;
+        size_t size;
+        bool await_ready()
+        {   // Small chunks complete without suspension
+            if (size > owner.inline_limit_)
+                return (false);
+            owner.hasher_.update_fast(data, size);
+            return (true);
+        }
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            IUFKeccak* hasher = &owner.hasher_;
+            const char* ptr = data;
+            size_t len = size;
+            owner.pool_.post([hasher, ptr, len, h] {
+                hasher->update_fast(ptr, len);
+                h.resume();
+            });
+        }
+        size_t await_resume() const noexcept  {  return (size);  }
+    };
+
+    UpdateAwaiter update(const char* data, const size_t size)
+    {   // WARNING: <data> must stay valid until the update completes
+        return (UpdateAwaiter{*this, data, size});
+    }
+    UpdateAwaiter update(const std::string& data)
+    {  return (update(data.data(), data.size()));  }
+
+    std::vector<byte> finalize() noexcept  {  return (hasher_.finalize());  }
+    IUFKeccak& hasher() noexcept  {  return (hasher_);  }
+
+private:
+    IUFKeccak& hasher_;
+    WorkerPool& pool_;
+    size_t inline_limit_;
+}; // end for class AsyncHasher
+
+#if defined(__unix__) || defined(__APPLE__)
+//====== Asynchronous reader of a file descriptor ======
+class FdSource
+{
+    struct State {      // shared between the awaiting coroutine and a worker
+        std::atomic<int> phase{kPending};
+        std::coroutine_handle<> waiting;
+        long result = 0;
+        int error = 0;
+    };
+    static const int kPending = 0, kWaiting = 1, kDone = 2;
+public:
+    FdSource(int fd, WorkerPool& pool) : fd_(fd), pool_(pool) {}
+
+    //------ Read operation (started on construction) ------
+    class ReadOp
+    {
+    public:
+        ReadOp() = default;
+        bool await_ready() const noexcept
+        {  return (state_->phase.load(std::memory_order_acquire) == kDone);  }
+        bool await_suspend(std::coroutine_handle<> h) noexcept
+        {   // don't suspend if the worker has already finished
+            state_->waiting = h;
+            int expected = kPending;
+            return (state_->phase.compare_exchange_strong(expected, kWaiting,
+                    std::memory_order_acq_rel));
+        }
+        long await_resume() const
+        {   // number of bytes read, 0 - end of file
+            if (state_->result < 0)
+                throw std::system_error(state_->error, std::generic_category());
+            return (state_->result);
+        }
+    private:
+        friend class FdSource;
+        explicit ReadOp(std::shared_ptr<State> st) : state_(std::move(st)) {}
+        std::shared_ptr<State> state_;
+    };
+
+    ReadOp read(char* buf, const size_t size)
+    {   // Read up to <size> bytes (retrying short reads) on a worker thread
+        auto st = std::make_shared<State>();
+        int fd = fd_;
+        pool_.post([st, fd, buf, size] {
+            size_t got = 0;
+            while (got < size) {
+                ssize_t n = ::read(fd, buf + got, size - got);
+                if (n < 0 and EINTR == errno)
+                    continue;
+                if (n < 0) {
+                    st->error = errno;
+                    break;
+                }
+                if (0 == n)
+                    break;
+                got += static_cast<size_t>(n);
+            }
+            st->result = st->error ? -1 : static_cast<long>(got);
+            if (st->phase.exchange(kDone, std::memory_order_acq_rel) == kWaiting)
+                st->waiting.resume();
+        });
+        return (ReadOp(std::move(st)));
+    }
+
+private:
+    int fd_;
+    WorkerPool& pool_;
+}; // end for class FdSource
+
+//-----------------------------------------------------------------------------
+inline Task<std::vector<byte>> hash_fd(int fd, IUFKeccak& obj, WorkerPool& pool,
+                                       size_t block_size = 1 << 20)
+{   // Digest of the whole file: the next block is read while the
+    // current one is being hashed (double buffering)
+    AsyncHasher hasher(obj, pool);
+    FdSource source(fd, pool);
+    const size_t rate8 = obj.get_rate() / k8Bits;
+    block_size = std::max<size_t>(block_size / rate8, 1) * rate8;
+    std::vector<char> buf[2] = { std::vector<char>(block_size),
+                                 std::vector<char>(block_size) };
+    int cur = 0;
+    FdSource::ReadOp pending = source.read(buf[cur].data(), block_size);
+    for (;;) {
+        long got = co_await pending;
+        if (got <= 0)
+            break;
+        pending = source.read(buf[cur ^ 1].data(), block_size);
+        co_await hasher.update(buf[cur].data(), static_cast<size_t>(got));
+        cur ^= 1;
+    }
+    co_return (hasher.finalize());
+} // end hash_fd(...)
+#endif  // POSIX
+
+} // end namespace "chash"
+
+#endif  // C++20
+
+//-----------------------------------------------------------------------------
+#endif /* SHA3_ASYNC_H_ */
@@ -0,0 +1,320 @@
+/******************************************************************************
+
+Copyright (c) 2022 Elijah Coleman
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef SHA3_CDC_H_
+#define SHA3_CDC_H_
+
+//-----------------------------------------------------------------------------
+// Content-defined chunking (FastCDC) with per-chunk digests for
+// deduplication.
+// ChunkPipeline streams the input through a gear rolling-hash boundary
+// detector; completed chunks are collected into batches which are hashed by
+// hash_many() (multi-buffer kernels) on background threads, while the
+// detector goes on with the next data. Records (offset, length, digest) are
+// delivered in input order on the caller's thread.
+
+#include "sha3_mb.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <future>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace chash     // "cryptographic hash"
+{
+//------ Gear table: 256 pseudo-random 64-bit values (splitmix64) ------
+struct GearTable {
+    int_t v[256];
+    constexpr GearTable() : v()
+    {
+        int_t x = 0x5348413343444321ULL;   // "SHA3CDC!"
+        for (int i = 0; i < 256; i++) {
+            int_t z = (x += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            v[i] = z ^ (z >> 31);
+        }
+    }
+};
+static constexpr GearTable kGear{};
+
+//------ Chunk size limits ------
+struct CDCParams {
+    size_t min_size = 2048;
+    size_t avg_size = 8192;         // power of 2
+    size_t max_size = 65536;
+};
+
+//====== FastCDC boundary detector ======
+class Chunker
+{
+public:
+    explicit Chunker(const CDCParams& params = CDCParams());
+
+    // Length of the chunk starting at <p> (<n> bytes available), or 0 if
+    // more data is needed to decide (<last> - no more data will follow)
+    size_t cut(const byte* p, size_t n, bool last) const noexcept;
+    const CDCParams& params() const noexcept  {  return (params_);  }
+
+private:
+    CDCParams params_;
+    int_t mask_s_;                  // before avg_size: more bits, harder cut
+    int_t mask_l_;                  // after avg_size: fewer bits, easier cut
+};  // end for class Chunker declaration
+
+//-----------------------------------------------------------------------------
+inline Chunker::Chunker(const CDCParams& params)
+    :   params_(params)
+{   // Normalized chunking: the masks take the high bits of the gear hash
+    // (they depend on the last 64 bytes)
+    int bits = 0;
+    while ((size_t(1) << (bits + 1)) <= params_.avg_size)
+        bits++;
+    mask_s_ = ~int_t(0) << (kLaneSize - (bits + 1));
+    mask_l_ = ~int_t(0) << (kLaneSize - (bits - 1));
+    if (params_.min_size == 0)
+        params_.min_size = 1;
+    if (params_.max_size < params_.min_size)
+        params_.max_size = params_.min_size;
+} // end Chunker(...)
+
+//-----------------------------------------------------------------------------
+inline size_t Chunker::cut(const byte* p, size_t n, bool last) const noexcept
+{
+    if (n <= params_.min_size)
+        return (last ? n : 0);
+    const size_t end = std::min<size_t>(n, params_.max_size);
+    const size_t normal = std::min<size_t>(end, params_.avg_size);
+    int_t fp = 0;
+    size_t i = params_.min_size;
+    for (; i < normal; i++) {
+        fp = (fp << 1) + kGear.v[p[i]];
+        if (!(fp & mask_s_))
+            return (i + 1);
+    }
+    for (; i < end; i++) {
+        fp = (fp << 1) + kGear.v[p[i]];
+        if (!(fp & mask_l_))
+            return (i + 1);
+    }
+    // No boundary: the maximal chunk, the end of data, or wait for more
+    return ((end == params_.max_size or last) ? end : 0);
+} // end cut(...)
+
+//====== end for class Chunker definition ======
+
+
+//------ A chunk of the stream ------
+struct ChunkRecord {
+    uint64_t offset;
+    uint32_t length;
+    const byte* digest;             // valid during the callback only
+};
+
+//====== Chunking + hashing pipeline ======
+class ChunkPipeline
+{
+public:
+    using Callback = std::function<void(const ChunkRecord&)>;
+
+    ChunkPipeline(const ChunkPipeline&) = delete;
+    ChunkPipeline& operator=(const ChunkPipeline&) = delete;
+
+    // <threads> - hashing threads (0 - hardware concurrency); <digest_bits> -
+    // output length for SHAKE (at most kMaxDigest bytes, std::invalid_argument
+    // otherwise)
+    explicit ChunkPipeline(Callback callback, const KeccParam& param = kSHA3_256,
+                           const CDCParams& params = CDCParams(),
+                           unsigned threads = 0, size_t digest_bits = 0);
+    ~ChunkPipeline();
+
+    void feed(const char* data, size_t size);
+    void finish();                  // flush the last chunk, wait for digests
+    size_t digest_size() const noexcept  {  return (digest8_);  }
+
+    static constexpr size_t kMaxDigest = 64;
+    static constexpr size_t kBatchBytes = 4 << 20;  // input per batch
+
+private:
+    struct Batch {
+        std::vector<byte> data;
+        uint64_t offset;            // of data[0] in the stream
+        std::vector<size_t> starts, lens;
+        std::vector<byte> digests;
+    };
+    void scan(bool last);
+    void submit();
+    void deliver();
+    void hash_batch(Batch& batch) const;
+
+    //------ Class Data Members ------
+    Callback callback_;
+    KeccParam param_;
+    Chunker chunker_;
+    unsigned threads_;
+    size_t digest_bits_;
+    size_t digest8_;
+    Batch cur_;                     // being filled and scanned
+    size_t scanned_;                // chunks of cur_ end here
+    std::unique_ptr<Batch> busy_;   // being hashed
+    std::future<void> job_;
+};  // end for class ChunkPipeline declaration
+
+//-----------------------------------------------------------------------------
+inline ChunkPipeline::ChunkPipeline(Callback callback, const KeccParam& param,
+                                    const CDCParams& params, unsigned threads,
+                                    size_t digest_bits)
+    :   callback_(std::move(callback)), param_(param), chunker_(params),
+        threads_(threads ? threads
+                         : std::max(1u, std::thread::hardware_concurrency())),
+        scanned_(0)
+{
+    if (!digest_bits or Domain::kDomSHA3 == param.dom)
+        digest_bits = static_cast<size_t>(param.hash_size);
+    if (digest_bits > kMaxDigest * k8Bits)
+        throw std::invalid_argument("ChunkPipeline: digest longer than kMaxDigest");
+    digest_bits_ = digest_bits;
+    digest8_ = (digest_bits_ + k8Bits - 1) / k8Bits;
+    cur_.offset = 0;
+    cur_.data.reserve(kBatchBytes + chunker_.params().max_size);
+} // end ChunkPipeline(...)
+
+//---------------------------------------
+inline ChunkPipeline::~ChunkPipeline()
+{
+    if (job_.valid())
+        job_.wait();
+} // end ~ChunkPipeline()
+
+//-----------------------------------------------------------------
+inline void ChunkPipeline::feed(const char* data, size_t size)
+{
+    while (size) {
+        size_t part = std::min<size_t>(size, kBatchBytes + chunker_.params().max_size
+                                             - cur_.data.size());
+        cur_.data.insert(cur_.data.end(), data, data + part);
+        data += part;
+        size -= part;
+        scan(false);
+        if (cur_.data.size() >= kBatchBytes)
+            submit();
+    }
+} // end feed(...)
+
+//---------------------------------------
+inline void ChunkPipeline::finish()
+{
+    scan(true);
+    submit();
+    deliver();
+} // end finish()
+
+//-----------------------------------------------
+inline void ChunkPipeline::scan(bool last)
+{   // Find the boundaries of the complete chunks of cur_
+    const byte* base = cur_.data.data();
+    while (scanned_ < cur_.data.size()) {
+        size_t len = chunker_.cut(base + scanned_, cur_.data.size() - scanned_, last);
+        if (!len)
+            break;
+        cur_.starts.push_back(scanned_);
+        cur_.lens.push_back(len);
+        scanned_ += len;
+    }
+} // end scan(...)
+
+//-----------------------------------------------
+inline void ChunkPipeline::submit()
+{   // Hand the complete chunks over to the hashing stage; the incomplete tail
+    // (at most max_size bytes) starts the next batch
+    if (cur_.starts.empty())
+        return;
+    auto batch = std::make_unique<Batch>();
+    batch->offset = cur_.offset + scanned_;
+    batch->data.reserve(cur_.data.capacity());
+    batch->data.assign(cur_.data.begin() + scanned_, cur_.data.end());
+    std::swap(*batch, cur_);        // batch - the full one, cur_ - the tail
+    batch->data.resize(scanned_);
+    scanned_ = 0;
+    deliver();                      // the previous batch (in order)
+    busy_ = std::move(batch);
+    Batch* job = busy_.get();
+    job_ = std::async(std::launch::async, [this, job] {  hash_batch(*job);  });
+} // end submit()
+
+//-----------------------------------------------
+inline void ChunkPipeline::deliver()
+{   // Wait for the batch being hashed and report its chunks
+    if (!busy_)
+        return;
+    job_.get();
+    for (size_t i = 0; i < busy_->starts.size(); i++) {
+        ChunkRecord rec{ busy_->offset + busy_->starts[i],
+                         static_cast<uint32_t>(busy_->lens[i]),
+                         busy_->digests.data() + i * digest8_ };
+        callback_(rec);
+    }
+    busy_.reset();
+} // end deliver()
+
+//-----------------------------------------------------------
+inline void ChunkPipeline::hash_batch(Batch& batch) const
+{   // hash_many over the chunks of the batch, split between the threads
+    const size_t count = batch.starts.size();
+    batch.digests.resize(count * digest8_);
+    std::vector<const char*> msgs(count);
+    std::vector<size_t> lens(count);
+    std::vector<byte*> outs(count);
+    for (size_t i = 0; i < count; i++) {
+        msgs[i] = reinterpret_cast<const char*>(batch.data.data() + batch.starts[i]);
+        lens[i] = batch.lens[i];
+        outs[i] = batch.digests.data() + i * digest8_;
+    }
+    const size_t parts = std::min<size_t>(threads_, (count + kMBWays - 1) / kMBWays);
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < parts; t++) {
+        size_t from = count * t / parts, to = count * (t + 1) / parts;
+        auto run = [&, from, to] {
+            hash_many(param_, msgs.data() + from, lens.data() + from,
+                      outs.data() + from, to - from, digest_bits_);
+        };
+        if (t + 1 == parts)
+            run();
+        else
+            pool.emplace_back(run);
+    }
+    for (auto& th : pool)
+        th.join();
+} // end hash_batch(...)
+
+//====== end for class ChunkPipeline definition ======
+
+} // end namespace "chash"
+
+//-----------------------------------------------------------------------------
+#endif /* SHA3_CDC_H_ */
@@ -0,0 +1,252 @@
+/******************************************************************************
+
+Copyright (c) 2022 Elijah Coleman
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef SHA3_CTX_H_
+#define SHA3_CTX_H_
+
+//-----------------------------------------------------------------------------
+// Compact streaming context for applications holding a huge number of
+// concurrent hashes (e.g. one per open upload stream).
+// KeccakCtx is a standard-layout, trivially copyable 208-byte struct: the
+// 200-byte state followed by the absorbed-byte counter, a one-byte tag with
+// the parameters (rate in lanes and the domain) and the digest size.
+// CtxArena hands out contexts from contiguous 64-byte aligned slabs.
+// Requires C++17 (aligned operator new).
+
+#include "sha3_ec.h"
+
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <vector>
+#include <type_traits>
+
+namespace chash     // "cryptographic hash"
+{
+//====== Compact streaming context ======
+struct KeccakCtx
+{
+    //------ Main Interface ------
+    void setup(const KeccParam& param) noexcept;
+    void init() noexcept;
+    bool set_digest_size(const size_t digest_size_in_bits) noexcept;
+    size_t update(const char* data, const size_t size) noexcept;
+    size_t finalize(byte* digest) noexcept;     // returns bytes written
+
+    size_t rate() const noexcept     {  return ((tag & kRateMask) * kLaneSize);  }
+    bool is_shake() const noexcept   {  return (tag & kShakeFlag);  }
+    size_t digest_size() const noexcept     // in bytes
+    {  return ((out_bits + k8Bits - 1) / k8Bits);  }
+
+    //------ Data Members ------
+    int_t         st[kStateSize];   // State (5 * 5 * w)
+    std::uint16_t absorbed;         // bytes absorbed in the current block
+    std::uint8_t  tag;              // rate in lanes | kShakeFlag
+    std::uint8_t  reserved;
+    std::uint32_t out_bits;         // digest size in bits
+
+    static const std::uint8_t kRateMask = 0x1F;
+    static const std::uint8_t kShakeFlag = 0x80;
+}; // end for struct KeccakCtx declaration
+
+static_assert(std::is_standard_layout<KeccakCtx>::value,
+              "KeccakCtx must be a standard-layout type!");
+static_assert(std::is_trivially_copyable<KeccakCtx>::value,
+              "KeccakCtx must be trivially copyable!");
+static_assert(sizeof(KeccakCtx) <= 208, "KeccakCtx must fit in 208 bytes!");
+
+//---------------------------------------------------------------
+inline void KeccakCtx::setup(const KeccParam& param) noexcept
+{
+    size_t hash_size = static_cast<size_t>(param.hash_size);
+    tag = static_cast<std::uint8_t>((kKeccakWidth - 2 * hash_size) / kLaneSize);
+    if (Domain::kDomSHAKE == param.dom)
+        tag |= kShakeFlag;
+    reserved = 0;
+    out_bits = static_cast<std::uint32_t>(hash_size);
+    init();
+} // end KeccakCtx::setup(...)
+
+//--------------------------------------
+inline void KeccakCtx::init() noexcept
+{
+    absorbed = 0;
+    for (int i = 0; i < kStateSize; i++)
+        st[i] = 0;
+} // end KeccakCtx::init()
+
+//--------------------------------------------------------------------------
+inline bool KeccakCtx::set_digest_size(const size_t hash_size_in_bits) noexcept
+{   // (!) For SHAKE functions ONLY (see Keccak::set_digest_size)
+    if (!is_shake())
+        return (false);
+    out_bits = static_cast<std::uint32_t>(
+        hash_size_in_bits % static_cast<size_t>(HashSize::kD_max));
+    return (true);
+} // end KeccakCtx::set_digest_size(...)
+
+//-----------------------------------------------------------------------------
+inline size_t KeccakCtx::update(const char* data, const size_t size) noexcept
+{   // Update State based on input data
+    if (nullptr == data)
+        return (0);
+    const size_t rate8 = rate() / k8Bits;
+    byte* st_raw = reinterpret_cast<byte*>(st);
+    const char* cur = data;
+    size_t left = size;
+    while (left) {
+        if (!absorbed and left >= rate8) {      // whole block by lanes
+            for (size_t i = 0; i < rate8 / kIntSize; i++) {
+                int_t lane;
+                std::memcpy(&lane, cur + i * kIntSize, kIntSize);
+                st[i] ^= lane;
+            }
+            keccak_f_fast(st);
+            cur += rate8;
+            left -= rate8;
+            continue;
+        }
+        size_t block = std::min<size_t>(left, rate8 - absorbed);
+        for (size_t i = 0; i < block; i++)
+            st_raw[absorbed + i] ^= static_cast<byte>(cur[i]);
+        absorbed = static_cast<std::uint16_t>(absorbed + block);
+        if (absorbed == rate8) {
+            keccak_f_fast(st);
+            absorbed = 0;
+        }
+        cur += block;
+        left -= block;
+    }
+    return (size);
+} // end KeccakCtx::update(...)
+
+//-----------------------------------------------------------
+inline size_t KeccakCtx::finalize(byte* digest) noexcept
+{   // Add domain separation and padding, squeeze <digest_size()> bytes
+    const size_t rate8 = rate() / k8Bits;
+    byte* st_raw = reinterpret_cast<byte*>(st);
+    st_raw[absorbed] ^= static_cast<byte>(is_shake() ?
+        static_cast<int_t>(Domain::kDomSHAKE) : static_cast<int_t>(Domain::kDomSHA3));
+    st_raw[rate8 - 1] ^= 0x80;
+    keccak_f_fast(st);
+    const size_t total = digest_size();
+    for (size_t squeezed = 0; squeezed < total; ) {
+        size_t block = std::min<size_t>(total - squeezed, rate8);
+        std::memcpy(digest + squeezed, st_raw, block);
+        squeezed += block;
+        if (squeezed < total)
+            keccak_f_fast(st);
+    }
+    if (out_bits % k8Bits)      // If digest size in bits not multiple by 8
+        digest[total - 1] &= 0xFF >> (k8Bits - out_bits % k8Bits);
+    absorbed = 0;
+    return (total);
+} // end KeccakCtx::finalize(...)
+
+//====== end for struct KeccakCtx definition ======
+
+
+//====== Slab allocator of contexts ======
+// Contexts are carved from contiguous 64-byte aligned slabs; released
+// contexts are kept in an intrusive free list. Not thread-safe: use one
+// arena per scheduler thread.
+class CtxArena
+{
+public:
+    CtxArena(const CtxArena&) = delete;
+    CtxArena& operator=(const CtxArena&) = delete;
+
+    explicit CtxArena(size_t contexts_per_slab = 1024)
+    :   per_slab_(contexts_per_slab ? contexts_per_slab : 1), free_(nullptr)
+    {}
+    ~CtxArena()
+    {
+        for (KeccakCtx* slab : slabs_)
+            ::operator delete(slab, std::align_val_t(kAlign));
+    }
+
+    //------ Main Interface ------
+    KeccakCtx* allocate(const KeccParam& param);
+    void release(KeccakCtx* ctx) noexcept;
+    KeccakCtx* allocate_array(size_t count, const KeccParam& param);
+    size_t slab_count() const noexcept  {  return (slabs_.size());  }
+
+    static const size_t kAlign = 64;
+
+private:
+    KeccakCtx* new_slab(size_t count);
+
+    //------ Class Data Members ------
+    size_t per_slab_;
+    KeccakCtx* free_;                   // free list (link in st[0])
+    std::vector<KeccakCtx*> slabs_;
+}; // end for class CtxArena declaration
+
+//-----------------------------------------------------
+inline KeccakCtx* CtxArena::new_slab(size_t count)
+{
+    void* mem = ::operator new(count * sizeof(KeccakCtx), std::align_val_t(kAlign));
+    slabs_.push_back(static_cast<KeccakCtx*>(mem));
+    return (slabs_.back());
+} // end new_slab(...)
+
+//----------------------------------------------------------------
+inline KeccakCtx* CtxArena::allocate(const KeccParam& param)
+{   // Take a context from the free list (a new slab if the list is empty)
+    if (!free_) {
+        KeccakCtx* slab = new_slab(per_slab_);
+        for (size_t i = per_slab_; i > 0; i--)
+            release(slab + i - 1);
+    }
+    KeccakCtx* ctx = free_;
+    std::memcpy(&free_, ctx->st, sizeof(free_));
+    ctx->setup(param);
+    return (ctx);
+} // end allocate(...)
+
+//-------------------------------------------------------
+inline void CtxArena::release(KeccakCtx* ctx) noexcept
+{
+    if (!ctx)
+        return;
+    std::memcpy(ctx->st, &free_, sizeof(free_));
+    free_ = ctx;
+} // end release(...)
+
+//-----------------------------------------------------------------------------
+inline KeccakCtx* CtxArena::allocate_array(size_t count, const KeccParam& param)
+{   // <count> contiguous contexts owned by the arena (not to be released)
+    KeccakCtx* arr = new_slab(count ? count : 1);
+    for (size_t i = 0; i < count; i++)
+        arr[i].setup(param);
+    return (arr);
+} // end allocate_array(...)
+
+//====== end for class CtxArena definition ======
+
+} // end namespace "chash"
+
+//-----------------------------------------------------------------------------
+#endif /* SHA3_CTX_H_ */
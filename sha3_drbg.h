@@ -0,0 +1,237 @@
+/******************************************************************************
+
+Copyright (c) 2022 Elijah Coleman
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef SHA3_DRBG_H_
+#define SHA3_DRBG_H_
+
+//-----------------------------------------------------------------------------
+// Deterministic random byte generator on a SHAKE sponge (SHAKE256 by
+// default). The seed is absorbed once; the output is the SHAKE output
+// stream of the seed, handed out straight from the State: when the rate
+// block is used up it is refilled by a single permutation. No allocation,
+// no output size limit. Not thread-safe: one object per thread (local()).
+
+#include "sha3_ec.h"
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace chash     // "cryptographic hash"
+{
+//====== SHAKE-based DRBG ======
+class ShakeDRBG
+{
+public:
+    explicit ShakeDRBG(const void* seed, const size_t len,
+                       const KeccParam& param = kSHAKE256) noexcept
+    {  setup(param);  seed_with(seed, len);  }
+    explicit ShakeDRBG(const std::string& seed,
+                       const KeccParam& param = kSHAKE256) noexcept
+    {  setup(param);  seed_with(seed.data(), seed.size());  }
+    ShakeDRBG();        // seeded from std::random_device
+
+    //------ Main Interface ------
+    void seed_with(const void* seed, const size_t len) noexcept;
+    void reseed(const void* data, const size_t len) noexcept;
+    void generate(void* out, size_t len) noexcept;
+    std::vector<byte> bytes(const size_t len);
+    ShakeDRBG split() noexcept;     // independent child generator
+
+    // Integer and floating point helpers
+    uint64_t next_u64() noexcept;
+    uint32_t next_u32() noexcept;
+    uint64_t uniform(const uint64_t bound) noexcept;    // [0, bound)
+    double next_double() noexcept;                      // [0, 1)
+    float next_float() noexcept;                        // [0, 1)
+
+    // UniformRandomBitGenerator (std::shuffle, <random> distributions)
+    using result_type = uint64_t;
+    static constexpr result_type min() noexcept  {  return (0);  }
+    static constexpr result_type max() noexcept
+    {  return (std::numeric_limits<result_type>::max());  }
+    result_type operator()() noexcept  {  return (next_u64());  }
+
+    static ShakeDRBG& local();      // the instance of the calling thread
+
+private:
+    void setup(const KeccParam& param) noexcept;
+    void absorb(const byte* p, size_t len) noexcept;
+
+    //------ Class Data Members ------
+    union {
+        int_t st_[kStateSize];                      // State (5 * 5 * w)
+        byte  st_raw_[kStateSize * sizeof(int_t)];  // State as byte array
+    };
+    size_t rate8_;      // rate in bytes
+    size_t pos_;        // bytes of the current rate block already given out
+    byte   domain_;     // domain separation suffix
+}; // end for class ShakeDRBG declaration
+
+//-----------------------------------------------------------
+inline void ShakeDRBG::setup(const KeccParam& param) noexcept
+{
+    rate8_ = (kKeccakWidth - 2 * static_cast<size_t>(param.hash_size)) / k8Bits;
+    domain_ = static_cast<byte>(param.dom);
+} // end setup(...)
+
+//------------------------------
+inline ShakeDRBG::ShakeDRBG()
+{
+    setup(kSHAKE256);
+    std::random_device rd;
+    uint32_t seed[16];
+    for (auto& word : seed)
+        word = rd();
+    seed_with(seed, sizeof(seed));
+} // end ShakeDRBG()
+
+//-----------------------------------------------------------------------------
+inline void ShakeDRBG::absorb(const byte* p, size_t len) noexcept
+{   // Absorbing of a padded message into the current State: whole blocks
+    // by the fused kernel, the tail with the suffix and the padding
+    const size_t nblocks = len / rate8_;
+    absorb_blocks(st_, rate8_ / kIntSize, p, nblocks);
+    p += nblocks * rate8_;
+    len -= nblocks * rate8_;
+    for (size_t i = 0; i < len; i++)
+        st_raw_[i] ^= p[i];
+    st_raw_[len] ^= domain_;
+    st_raw_[rate8_ - 1] ^= 0x80;
+    keccak_f_fast(st_);
+    pos_ = 0;
+} // end absorb(...)
+
+//-----------------------------------------------------------------------------
+inline void ShakeDRBG::seed_with(const void* seed, const size_t len) noexcept
+{   // The output is SHAKE(seed)
+    std::memset(st_, 0, sizeof(st_));
+    absorb(static_cast<const byte*>(seed), len);
+} // end seed_with(...)
+
+//-----------------------------------------------------------------------------
+inline void ShakeDRBG::reseed(const void* data, const size_t len) noexcept
+{   // Additional input is absorbed into the current State: the following
+    // output depends on the seed, all the reseeds and the output position
+    absorb(static_cast<const byte*>(data), len);
+} // end reseed(...)
+
+//-------------------------------------------------------------
+inline void ShakeDRBG::generate(void* out, size_t len) noexcept
+{   // Squeezing: the rest of the current block, then whole blocks (one
+    // permutation per rate bytes)
+    byte* dst = static_cast<byte*>(out);
+    while (len) {
+        if (pos_ == rate8_) {
+            keccak_f_fast(st_);
+            pos_ = 0;
+        }
+        size_t n = std::min<size_t>(len, rate8_ - pos_);
+        std::memcpy(dst, st_raw_ + pos_, n);
+        pos_ += n;
+        dst += n;
+        len -= n;
+    }
+} // end generate(...)
+
+//-----------------------------------------------------------
+inline std::vector<byte> ShakeDRBG::bytes(const size_t len)
+{
+    std::vector<byte> res(len);
+    generate(res.data(), len);
+    return (res);
+} // end bytes(...)
+
+//------------------------------------------
+inline ShakeDRBG ShakeDRBG::split() noexcept
+{   // A child seeded by the next 64 output bytes (e.g. one per thread)
+    byte seed[64];
+    generate(seed, sizeof(seed));
+    ShakeDRBG child(*this);                 // the same parameters
+    child.seed_with(seed, sizeof(seed));
+    return (child);
+} // end split()
+
+//------------------------------------------
+inline uint64_t ShakeDRBG::next_u64() noexcept
+{
+    uint64_t res;
+    if (pos_ + sizeof(res) <= rate8_) {     // fast path: within the block
+        std::memcpy(&res, st_raw_ + pos_, sizeof(res));
+        pos_ += sizeof(res);
+    }
+    else
+        generate(&res, sizeof(res));
+    return (res);
+} // end next_u64()
+
+//------------------------------------------
+inline uint32_t ShakeDRBG::next_u32() noexcept
+{
+    uint32_t res;
+    generate(&res, sizeof(res));
+    return (res);
+} // end next_u32()
+
+//-------------------------------------------------------------
+inline uint64_t ShakeDRBG::uniform(const uint64_t bound) noexcept
+{   // Unbiased: the values below 2^64 mod <bound> are rejected
+    if (bound < 2)
+        return (0);
+    const uint64_t threshold = (0 - bound) % bound;
+    for (;;) {
+        uint64_t r = next_u64();
+        if (r >= threshold)
+            return (r % bound);
+    }
+} // end uniform(...)
+
+//--------------------------------------------
+inline double ShakeDRBG::next_double() noexcept
+{   // 53 random bits of the mantissa
+    return ((next_u64() >> 11) * (1.0 / (UINT64_C(1) << 53)));
+} // end next_double()
+
+//------------------------------------------
+inline float ShakeDRBG::next_float() noexcept
+{   // 24 random bits of the mantissa
+    return ((next_u32() >> 8) * (1.0f / (1u << 24)));
+} // end next_float()
+
+//------------------------------------------
+inline ShakeDRBG& ShakeDRBG::local()
+{   // Seeded from std::random_device on the first use in each thread
+    thread_local ShakeDRBG drbg;
+    return (drbg);
+} // end local()
+//====== end for class ShakeDRBG definition ======
+
+} // end namespace "chash"
+
+//-----------------------------------------------------------------------------
+#endif /* SHA3_DRBG_H_ */
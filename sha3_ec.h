@@ -30,9 +30,28 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <vector>
 #include <string>
+#include <array>
+#include <cstring>
+#include <cstdint>
 #include <iostream>
 #include <iomanip>
 
+#if defined(__unix__) or defined(__APPLE__)
+#include <sys/uio.h>            // struct iovec (scatter-gather update)
+#endif
+
+// The register-resident kernels rely on full unrolling of the step mappings
+// (all lanes in registers, constant rotation counts); -O2 does not unroll them
+#ifndef SHA3_UNROLL
+#if defined(__clang__)
+#define SHA3_UNROLL _Pragma("unroll")
+#elif defined(__GNUC__)
+#define SHA3_UNROLL _Pragma("GCC unroll 25")
+#else
+#define SHA3_UNROLL
+#endif
+#endif
+
 namespace chash     // "cryptographic hash"
 {
 //------ TYPES ALIASES ------
@@ -85,7 +104,7 @@ static const int    kRounds = 24;
 static const size_t kLaneSize = 64;         // lane size in bits
 static const int_t  kIntMax = 0xFFFFFFFFFFFFFFFFULL;
 
-static const size_t kRhoOffset[kStateSize] = {  // offsets for RHO step mapping
+static constexpr size_t kRhoOffset[kStateSize] = {  // offsets for RHO step mapping
      0,  1, 62, 28, 27,
     36, 44,  6, 55, 20,
      3, 10, 43, 25, 39,
@@ -93,12 +112,12 @@ static const size_t kRhoOffset[kStateSize] = {  // offsets for RHO step mapping
     18,  2, 61, 56, 14
 };
 
-static const int_t kPiJmp[kStateSize-1] = {     // for PI step mapping
+static constexpr int_t kPiJmp[kStateSize-1] = {     // for PI step mapping
     1, 6, 9, 22, 14, 20, 2, 12, 13, 19, 23, 15, 4, 24, 21, 8, 16, 5, 3, 18,
     17, 11, 7, 10
 };
 
-static const int_t kIotaRc[kRounds] = {// round constants for IOTA step mapping
+static constexpr int_t kIotaRc[kRounds] = {// round constants for IOTA step mapping
     0x0000000000000001, 0x0000000000008082, 0x800000000000808A,
     0x8000000080008000, 0x000000000000808B, 0x0000000080000001,
     0x8000000080008081, 0x8000000000008009, 0x000000000000008A,
@@ -110,12 +129,133 @@ static const int_t kIotaRc[kRounds] = {// round constants for IOTA step mapping
 };
 
 //------ Helper Functions (Inline only) ------
-inline int_t rotl(int_t n, size_t offset) noexcept
+constexpr int_t rotl(int_t n, size_t offset) noexcept
 {	// left-rotating the value of <n> by <offset> positions
     // If C++20 is used may be replaced by "std::rotl"
-    return((n << offset) | (n >> (sizeof(n) * k8Bits - offset)));
+    // (masking the right shift keeps <offset> == 0 well-defined)
+    return((n << offset) | (n >> ((sizeof(n) * k8Bits - offset) % kLaneSize)));
 }
 
+//---------------------------------------------------
+constexpr void keccak_f(int_t st[kStateSize]) noexcept
+{   // KECCAK-f[1600] permutation over a bare state (5 * 5 lanes)
+    // constexpr: can be evaluated at compile time (see keccak_const)
+    for (int rc = 0; rc < kRounds; rc++) {
+        // THETA
+        int_t sht_l[5] = {};        // "sheet"
+        int_t sht_r[5] = {};
+        for (int x = 0; x < 5; x++) {    // traverse through sheets
+            sht_l[x] = st[x]^st[x+5]^st[x+10]^st[x+15]^st[x+20];
+            sht_r[x] = rotl(sht_l[x],1);
+        }
+        for (int x = 0; x < 5; x++) {
+            for (int y = 0; y < 5; y++)
+                st[x + y*5] ^= sht_l[(x+4)%5] ^ sht_r[(x+1) % 5];
+        }
+        // RHO & PI
+        int_t lane1 = rotl(st[1], kRhoOffset[1]);
+        for (int i = 0; i < kStateSize-2; i++)
+            st[kPiJmp[i]] = rotl(st[kPiJmp[i+1]], kRhoOffset[kPiJmp[i+1]]);
+        st[kPiJmp[23]] = lane1;
+        // CHI
+        for (int y = 0; y < kStateSize; y += 5) {   // traverse through rows
+            sht_l[0] = st[y];
+            sht_l[1] = st[y+1];
+            for (int x = 0; x < 3; x++) {
+                //st[y+x] ^= (~st[y+(x+1)]) & st[y+(x+2)];
+                st[y+x] ^= (st[y+(x+1)] ^ kIntMax) & st[y+(x+2)];
+            }
+            st[y+3] ^= (~st[y+4]) & sht_l[0];
+            st[y+4] ^= (~sht_l[0]) & sht_l[1];
+        }
+        // IOTA
+        st[0] ^= kIotaRc[rc];
+    } // end for(size_t rc...)
+} // end keccak_f(...)
+
+//---------------------------------------------------
+inline void keccak_round(int_t (&a)[kStateSize], const int_t rc) noexcept
+{   // One round of KECCAK-f[1600] over a local state: all indices are
+    // constant after unrolling, so the lanes stay in registers
+    int_t c[5], d[5], b[kStateSize];
+    SHA3_UNROLL
+    for (int x = 0; x < 5; x++)
+        c[x] = a[x] ^ a[x+5] ^ a[x+10] ^ a[x+15] ^ a[x+20];
+    SHA3_UNROLL
+    for (int x = 0; x < 5; x++)
+        d[x] = c[(x+4) % 5] ^ rotl(c[(x+1) % 5], 1);
+    // THETA, RHO & PI: B[y, 2x + 3y] = ROT(A[x, y] ^ D[x], r[x, y])
+    SHA3_UNROLL
+    for (int y = 0; y < 5; y++)
+        SHA3_UNROLL
+        for (int x = 0; x < 5; x++)
+            b[y + 5*((2*x + 3*y) % 5)] = rotl(a[x + 5*y] ^ d[x],
+                                              kRhoOffset[x + 5*y]);
+    // CHI
+    SHA3_UNROLL
+    for (int y = 0; y < kStateSize; y += 5)
+        SHA3_UNROLL
+        for (int x = 0; x < 5; x++)
+            a[y+x] = b[y+x] ^ (~b[y + (x+1) % 5] & b[y + (x+2) % 5]);
+    // IOTA
+    a[0] ^= rc;
+} // end keccak_round(...)
+
+//---------------------------------------------------
+inline void keccak_f_fast(int_t st[kStateSize]) noexcept
+{   // KECCAK-f[1600] with the state in registers (runtime counterpart of
+    // the constexpr keccak_f)
+    int_t a[kStateSize];
+    std::memcpy(a, st, sizeof(a));
+    for (int rc = 0; rc < kRounds; rc++)
+        keccak_round(a, kIotaRc[rc]);
+    std::memcpy(st, a, sizeof(a));
+} // end keccak_f_fast(...)
+
+//---------------------------------------------------
+template<size_t kRateLanes>
+inline void absorb_blocks(int_t st[kStateSize], const byte* p,
+                          size_t nblocks) noexcept
+{   // Absorb <nblocks> whole blocks of <kRateLanes> lanes: the state is
+    // loaded once, every block is XORed in and permuted in registers, and
+    // the state is written back only at the end
+    int_t a[kStateSize];
+    std::memcpy(a, st, sizeof(a));
+    for (; nblocks; nblocks--, p += kRateLanes * kIntSize) {
+        SHA3_UNROLL
+        for (size_t i = 0; i < kRateLanes; i++) {
+            int_t lane;
+            std::memcpy(&lane, p + i * kIntSize, kIntSize);
+            a[i] ^= lane;
+        }
+        for (int rc = 0; rc < kRounds; rc++)
+            keccak_round(a, kIotaRc[rc]);
+    }
+    std::memcpy(st, a, sizeof(a));
+} // end absorb_blocks(...)
+
+//---------------------------------------------------
+inline void absorb_blocks(int_t st[kStateSize], const size_t rate_lanes,
+                          const byte* p, const size_t nblocks) noexcept
+{   // Dispatch to the kernel specialized for the rate (in lanes)
+    switch (rate_lanes) {
+    case 21: absorb_blocks<21>(st, p, nblocks); break;     // SHAKE128
+    case 18: absorb_blocks<18>(st, p, nblocks); break;     // SHA3-224
+    case 17: absorb_blocks<17>(st, p, nblocks); break;     // SHA3-256, SHAKE256
+    case 13: absorb_blocks<13>(st, p, nblocks); break;     // SHA3-384
+    case  9: absorb_blocks< 9>(st, p, nblocks); break;     // SHA3-512
+    default:
+        for (size_t n = 0; n < nblocks; n++, p += rate_lanes * kIntSize) {
+            for (size_t i = 0; i < rate_lanes; i++) {
+                int_t lane;
+                std::memcpy(&lane, p + i * kIntSize, kIntSize);
+                st[i] ^= lane;
+            }
+            keccak_f_fast(st);
+        }
+    }
+} // end absorb_blocks(...)
+
 //====== Basic class of SHA3 specification ======
 class Keccak
 {
@@ -127,7 +267,7 @@ public:
 
     explicit Keccak(KeccParam param) {  setup(param);  }
     Keccak() {  setup(kSHA3_256);  }     // by default SHA3-256
-    ~Keccak() {};
+    virtual ~Keccak() {};
 
     //------ Main Interface ------
     virtual void setup(const KeccParam &param);
@@ -234,37 +374,7 @@ std::string Keccak::get_hash_type() noexcept
 //------------------------------
 void Keccak::keccak_p() noexcept
 {   // Underlying KECCAK permutation
-    for (int rc = 0; rc < kRounds; rc++) {
-        // THETA
-        int_t sht_l[5];             // "sheet"
-        int_t sht_r[5];
-        for (int x = 0; x < 5; x++) {    // traverse through sheets
-            sht_l[x] = st_[x]^st_[x+5]^st_[x+10]^st_[x+15]^st_[x+20];
-            sht_r[x] = rotl(sht_l[x],1);
-        }
-        for (int x = 0; x < 5; x++) {
-            for (int y = 0; y < 5; y++)
-                st_[x + y*5] ^= sht_l[(x+4)%5] ^ sht_r[(x+1) % 5];
-        }
-        // RHO & PI
-        int_t lane1 = rotl(st_[1], kRhoOffset[1]);
-        for (int i = 0; i < kStateSize-2; i++)
-            st_[kPiJmp[i]] = rotl(st_[kPiJmp[i+1]], kRhoOffset[kPiJmp[i+1]]);
-        st_[kPiJmp[23]] = lane1;
-        // CHI
-        for (int y = 0; y < kStateSize; y += 5) {   // traverse through rows
-            sht_l[0] = st_[y];
-            sht_l[1] = st_[y+1];
-            for (int x = 0; x < 3; x++) {
-                //st_[y+x] ^= (~st_[y+(x+1)]) & st_[y+(x+2)];
-                st_[y+x] ^= (st_[y+(x+1)] ^ kIntMax) & st_[y+(x+2)];
-            }
-            st_[y+3] ^= (~st_[y+4]) & sht_l[0];
-            st_[y+4] ^= (~sht_l[0]) & sht_l[1];
-        }
-        // IOTA
-        st_[0] ^= kIotaRc[rc];
-    } // end for(size_t rc...)
+    keccak_f_fast(st_);
 } // end keccak_p()
 
 //---------------------------------------------------------------------
@@ -322,7 +432,7 @@ std::vector<byte> Keccak::squeeze() noexcept
     for (size_t i = 0; i < (hash_size_ / rate_ + 1); i++) {
         size_t block_size = std::min((hash_size_ - squeezed), rate_);
         if (block_size == rate_) {
-            int_t* cur = reinterpret_cast<int_t*>(digest.data()) + squeezed / k8Bits;
+            int_t* cur = reinterpret_cast<int_t*>(digest.data()) + squeezed / kLaneSize;
             for (int i = 0; i < rate_ / kLaneSize; i++, cur++)
                 *cur = st_[i];
         }
@@ -392,13 +502,32 @@ public:
     size_t update(const str_const_iter start, const str_const_iter end);
     size_t update(const std::string& data);
 
+    // Scatter-gather: a chain of segments is absorbed as one contiguous
+    // message (the State stays lane-aligned across segment boundaries)
+#if defined(__unix__) or defined(__APPLE__)
+    size_t update(const struct iovec* iov, const int iovcnt);
+#endif
+    template<class Segments>    // sequence of segments with data() and size()
+    size_t update_segments(const Segments& segments);
+
+    // Midstate serialization: the absorption may be resumed later (by another
+    // object, process or run) from the byte_total() offset of the message
+    std::vector<byte> save_midstate() const;
+    bool load_midstate(const byte* data, const size_t size) noexcept;
+    size_t byte_total() const noexcept  {  return (byte_total_);  }
+    static constexpr size_t kMidstateSize = 264;    // bytes
+
     // Utility functions
     void set_separator(const char sep) noexcept   {  separator_ = sep;  }
     friend std::ostream& operator<<(std::ostream& out, chash::IUFKeccak& obj);
 
-private:		// Class Data Members
+private:
+    inline void xor_bytes(size_t offset, const char* p, size_t n) noexcept;
+
+    //------ Class Data Members ------
     size_t rate_in_bytes_;
     size_t byte_absorbed_;
+    size_t byte_total_;         // bytes absorbed since init()
     char   separator_;
 }; // end for class IUFKeccak declaration
 
@@ -413,6 +542,7 @@ void IUFKeccak::setup(const KeccParam& param)
 void IUFKeccak::init() noexcept
 {
     byte_absorbed_ = 0;
+    byte_total_ = 0;
     this->reset_state();
 } // end init()
 
@@ -433,22 +563,30 @@ size_t IUFKeccak::update_fast(const char* data, const size_t size)
 {   // Some optimization for loading data into State
     size_t rate_in_8byte = rate_in_bytes_ / kIntSize; // rate as array of int_t
     size_t left_to_process = size;
+    if (nullptr == data)
+        return (0);
 
+    // Complete the partially absorbed block first, so that input chunks
+    // not aligned to the rate still reach the fast path below
+    if (byte_absorbed_) {
+        size_t head = std::min(left_to_process, rate_in_bytes_ - byte_absorbed_);
+        update(data, head);
+        left_to_process -= head;
+    }
     // For the case when the data block is absorbed by the state starting
     // from st_[0] (i.e. byte_absorbed_ == 0), and the block size is equal
     // to the rate: we absorb by 8 bytes at once (as an 8 byte integer)
-    if(!byte_absorbed_ and (left_to_process/rate_in_8byte)) {
-        const int_t* block = reinterpret_cast<const int_t*>(data);
-        while(left_to_process > rate_in_bytes_) {
-            for(size_t i = 0; i < rate_in_8byte; i++)
-                st_[i] ^= block[i];
-            block += rate_in_8byte;
-            left_to_process -= rate_in_bytes_;
-            this->keccak_p();
-        }
+    if(!byte_absorbed_ and (left_to_process >= rate_in_bytes_)) {
+        // All whole blocks at once by the fused kernel (state in registers)
+        size_t nblocks = left_to_process / rate_in_bytes_;
+        absorb_blocks(st_, rate_in_8byte, reinterpret_cast<const byte*>(
+                      data + (size - left_to_process)), nblocks);
+        left_to_process -= nblocks * rate_in_bytes_;
+        byte_total_ += nblocks * rate_in_bytes_;
     }
     // The remaining bytes are absorbed in a simple way (byte by byte)
-    return (update(data + (size - left_to_process), left_to_process));
+    update(data + (size - left_to_process), left_to_process);
+    return (size);
 } // end IUFKeccak::update_fast()
 
 //-----------------------------------------------------------
@@ -462,9 +600,7 @@ size_t IUFKeccak::update(const char* data, const size_t size)
     const char* block = data;
 
     while (left_to_process) {
-        for (const char* cur = block; cur != block + block_size; cur++) {
-            this->st_raw_[byte_absorbed_ + (cur - block)] ^= *cur;
-        }
+        xor_bytes(byte_absorbed_, block, block_size);
         byte_absorbed_ += block_size;
         if (byte_absorbed_ == rate_in_bytes_) {
             this->keccak_p();
@@ -476,9 +612,123 @@ size_t IUFKeccak::update(const char* data, const size_t size)
             block_size = std::min(left_to_process, rate_in_bytes_);
         }
     } // end while(left_to_process)
+    byte_total_ += size;
     return (size);
 } // end update(...)
 
+//-----------------------------------------------------------------------------
+void IUFKeccak::xor_bytes(size_t offset, const char* p, size_t n) noexcept
+{   // XOR <n> bytes into the State starting from byte <offset>: whole lanes
+    // at once where the offset is lane-aligned, single bytes at the edges
+    for (; n and (offset % kIntSize); n--)
+        this->st_raw_[offset++] ^= *p++;
+    for (; n >= kIntSize; n -= kIntSize, p += kIntSize, offset += kIntSize) {
+        int_t lane;
+        std::memcpy(&lane, p, kIntSize);
+        this->st_[offset / kIntSize] ^= lane;
+    }
+    for (; n; n--)
+        this->st_raw_[offset++] ^= *p++;
+} // end xor_bytes(...)
+
+#if defined(__unix__) or defined(__APPLE__)
+//-----------------------------------------------------------------------
+size_t IUFKeccak::update(const struct iovec* iov, const int iovcnt)
+{   // Absorb <iovcnt> segments (readv/recvmsg layout) as one message
+    if (nullptr == iov)
+        return (0);
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++)
+        total += update_fast(static_cast<const char*>(iov[i].iov_base),
+                             iov[i].iov_len);
+    return (total);
+} // end update(iovec...)
+#endif
+
+//------------------------------------------------------------------
+template<class Segments>
+size_t IUFKeccak::update_segments(const Segments& segments)
+{   // E.g. std::vector<std::string_view>, std::span<std::span<const char>>
+    size_t total = 0;
+    for (const auto& seg : segments)
+        total += update_fast(reinterpret_cast<const char*>(seg.data()),
+                             seg.size());
+    return (total);
+} // end update_segments(...)
+
+//-----------------------------------------------------------------------------
+// Midstate format (kMidstateSize bytes; the fields are copied in the host
+// byte order, so a record is resumed on the same kind of machine):
+//   magic "KCMS" | u16 version | u16 rate (bytes) | u32 digest size (bits) |
+//   u32 domain | u64 byte_absorbed | u64 byte_total | 200-byte state |
+//   SHA3-256 of all the preceding fields
+static constexpr byte kMidstateMagic[4] = { 'K', 'C', 'M', 'S' };
+static constexpr uint16_t kMidstateVersion = 1;
+
+//-----------------------------------------------------------
+std::vector<byte> IUFKeccak::save_midstate() const
+{
+    std::vector<byte> out(kMidstateSize);
+    byte* p = out.data();
+    auto put = [&p](const void* src, size_t n) {
+        std::memcpy(p, src, n);
+        p += n;
+    };
+    const uint16_t rate8 = static_cast<uint16_t>(rate_in_bytes_);
+    const uint32_t digest_bits = static_cast<uint32_t>(hash_size_);
+    const uint32_t dom = static_cast<uint32_t>(domain_);
+    const uint64_t absorbed = byte_absorbed_, total = byte_total_;
+    put(kMidstateMagic, sizeof(kMidstateMagic));
+    put(&kMidstateVersion, sizeof(kMidstateVersion));
+    put(&rate8, sizeof(rate8));
+    put(&digest_bits, sizeof(digest_bits));
+    put(&dom, sizeof(dom));
+    put(&absorbed, sizeof(absorbed));
+    put(&total, sizeof(total));
+    put(st_raw_, sizeof(st_raw_));
+    Keccak chk(kSHA3_256);
+    std::vector<byte> sum = chk.get_digest(reinterpret_cast<const char*>(out.data()),
+                                           (p - out.data()) * k8Bits);
+    put(sum.data(), sum.size());
+    return (out);
+} // end save_midstate()
+
+//-----------------------------------------------------------------------------
+bool IUFKeccak::load_midstate(const byte* data, const size_t size) noexcept
+{   // false (the object is not changed) if the record is damaged or was saved
+    // for other parameters (rate, domain and digest size must match)
+    if (nullptr == data or size != kMidstateSize
+            or std::memcmp(data, kMidstateMagic, sizeof(kMidstateMagic)))
+        return (false);
+    Keccak chk(kSHA3_256);
+    std::vector<byte> sum = chk.get_digest(reinterpret_cast<const char*>(data),
+                                           (kMidstateSize - 32) * k8Bits);
+    if (std::memcmp(sum.data(), data + kMidstateSize - 32, 32))
+        return (false);
+    const byte* p = data + sizeof(kMidstateMagic);
+    auto get = [&p](void* dst, size_t n) {
+        std::memcpy(dst, p, n);
+        p += n;
+    };
+    uint16_t version, rate8;
+    uint32_t digest_bits, dom;
+    uint64_t absorbed, total;
+    get(&version, sizeof(version));
+    get(&rate8, sizeof(rate8));
+    get(&digest_bits, sizeof(digest_bits));
+    get(&dom, sizeof(dom));
+    get(&absorbed, sizeof(absorbed));
+    get(&total, sizeof(total));
+    if (version != kMidstateVersion or rate8 != rate_in_bytes_
+            or dom != domain_ or digest_bits != hash_size_
+            or absorbed >= rate_in_bytes_)
+        return (false);
+    get(st_raw_, sizeof(st_raw_));
+    byte_absorbed_ = absorbed;
+    byte_total_ = total;
+    return (true);
+} // end load_midstate(...)
+
 //----------------------------------------------
 std::vector<byte> IUFKeccak::finalize() noexcept
 {   // Add domain separation and padding, return digest
@@ -492,25 +742,312 @@ std::vector<byte> IUFKeccak::finalize() noexcept
 
 //------ Overload output for IUFKeccak ------
 std::ostream& operator<<(std::ostream& out, chash::IUFKeccak& obj)
-{
+{   // The digest is formatted in place (std::uppercase is honoured) and
+    // written at once; the stream is not flushed
     std::vector<chash::byte> digest = obj.finalize();
-    char prev_fill = out.fill('0');
-    out << std::hex;
+    const char* hex = (out.flags() & std::ios_base::uppercase)
+                    ? "0123456789ABCDEF" : "0123456789abcdef";
+    std::string line;
+    line.reserve(3 * digest.size());
     for(size_t i = 0; i < digest.size(); i++) {
-        out << std::setw(2) << static_cast<int>(digest[i]);
+        line.push_back(hex[digest[i] >> 4]);
+        line.push_back(hex[digest[i] & 0x0F]);
         if(obj.separator_ and (i+1 != digest.size()))
-            out << obj.separator_;
+            line.push_back(obj.separator_);
     }
-    out.fill(prev_fill);
-    out << std::flush << std::dec;
+    out.write(line.data(), static_cast<std::streamsize>(line.size()));
     return (out);
 } // end
 
 //====== end for class IUFKeccak definition ======
 
+
+//====== Duplex construction ======
+// Every duplex() call absorbs one padded input block, applies exactly one
+// permutation and returns the first bytes of the new State, so a transcript
+// of many short messages may be challenged after each message at the cost
+// of one permutation per message (without re-absorbing the transcript).
+// The first call from init() gives the same output as the sponge (SHA3 or
+// SHAKE) for the same input.
+class KeccakDuplex : public Keccak
+{
+public:
+    KeccakDuplex(const KeccakDuplex&) = delete;    // copy/move constructors in undef
+    KeccakDuplex(const KeccakDuplex&&) = delete;
+    KeccakDuplex& operator=(KeccakDuplex&) = delete; // copy/move assignment is undef
+    KeccakDuplex& operator=(KeccakDuplex&&) = delete;
+
+    explicit KeccakDuplex(KeccParam param) : Keccak(param) {  init();  }
+    KeccakDuplex() : Keccak(kSHA3_256) {  init();  }   // by default SHA3-256
+    ~KeccakDuplex() {}
+
+    //------ Main Interface ------
+    virtual void setup(const KeccParam& param) override;
+    void init() noexcept  {  this->reset_state();  }
+    bool duplex(const byte* in, const size_t in_len,
+                byte* out, const size_t out_len) noexcept;
+    std::vector<byte> duplex(const std::string& in, const size_t out_len);
+
+    // Absorb/ratchet/squeeze over duplex calls (any lengths); the names
+    // do not hide the sponge absorb()/squeeze() of Keccak
+    void absorb_bytes(const byte* msg, const size_t len) noexcept;
+    void squeeze_bytes(byte* out, const size_t len) noexcept;
+    void ratchet() noexcept;
+
+    // Limits of one duplex() call (in bytes)
+    size_t max_input() const noexcept   {  return (rate_ / k8Bits - 1);  }
+    size_t max_output() const noexcept  {  return (rate_ / k8Bits);  }
+}; // end for class KeccakDuplex declaration
+
+//---------------------------------------------
+void KeccakDuplex::setup(const KeccParam& param)
+{
+    Keccak::setup(param);
+    init();
+} // end KeccakDuplex::setup(...)
+
+//-----------------------------------------------------------------------------
+bool KeccakDuplex::duplex(const byte* in, const size_t in_len,
+                          byte* out, const size_t out_len) noexcept
+{   // false (the State is not changed) if <in_len> > max_input() or
+    // <out_len> > max_output()
+    const size_t rate8 = rate_ / k8Bits;
+    if (in_len > rate8 - 1 or out_len > rate8
+            or (in_len and !in) or (out_len and !out))
+        return (false);
+    size_t i = 0;
+    for (; i + kIntSize <= in_len; i += kIntSize) {     // whole lanes
+        int_t lane;
+        std::memcpy(&lane, in + i, kIntSize);
+        st_[i / kIntSize] ^= lane;
+    }
+    for (; i < in_len; i++)
+        st_raw_[i] ^= in[i];
+    st_raw_[in_len] ^= static_cast<byte>(domain_);      // pad per call
+    st_raw_[rate8 - 1] ^= 0x80;
+    keccak_p();
+    if (out_len)
+        std::memcpy(out, st_raw_, out_len);
+    return (true);
+} // end duplex(...)
+
+//-----------------------------------------------------------------------------
+std::vector<byte> KeccakDuplex::duplex(const std::string& in, const size_t out_len)
+{   // Wrapper function: an empty vector if the lengths exceed the limits
+    std::vector<byte> out(out_len);
+    if (!duplex(reinterpret_cast<const byte*>(in.data()), in.size(),
+                out.data(), out_len))
+        out.clear();
+    return (out);
+} // end duplex(...)
+
+//-----------------------------------------------------------------
+void KeccakDuplex::absorb_bytes(const byte* msg, const size_t len) noexcept
+{   // One duplex call per max_input() bytes (an empty message - one call)
+    const size_t block = max_input();
+    size_t done = 0;
+    do {
+        size_t n = std::min(len - done, block);
+        duplex(msg + done, n, nullptr, 0);
+        done += n;
+    } while (done < len);
+} // end absorb_bytes(...)
+
+//------------------------------------------------------------
+void KeccakDuplex::squeeze_bytes(byte* out, const size_t len) noexcept
+{   // One duplex call (empty input) per max_output() bytes
+    for (size_t done = 0; done < len; ) {
+        size_t n = std::min(len - done, max_output());
+        duplex(nullptr, 0, out + done, n);
+        done += n;
+    }
+} // end squeeze_bytes(...)
+
+//---------------------------------
+void KeccakDuplex::ratchet() noexcept
+{   // Permute and zero the rate part: the previous State can not be
+    // recovered from the current one (forward secrecy)
+    keccak_p();
+    std::memset(st_raw_, 0, rate_ / k8Bits);
+} // end ratchet()
+//====== end for class KeccakDuplex definition ======
+
+
+//====== One-block KECCAK (short fixed-size messages) ======
+// For messages shorter than the rate: the message lanes, the domain
+// separation suffix and the padding are loaded straight into the state,
+// then exactly one permutation is applied and the digest lanes are stored.
+// No heap allocation, no block bookkeeping.
+template<HashSize kHashSize, Domain kDom = Domain::kDomSHA3>
+struct OneBlock
+{
+    static constexpr size_t kRate8 =                        // rate in bytes
+        (kKeccakWidth - 2 * static_cast<size_t>(kHashSize)) / k8Bits;
+    static constexpr size_t kDigest8 =                      // digest in bytes
+        static_cast<size_t>(kHashSize) / k8Bits;
+
+    template<size_t kLen, size_t kOut = kDigest8>
+    static void hash(const byte* msg, byte* digest) noexcept
+    {   // Length of the message is known at compile time
+        static_assert(kLen < kRate8, "Message must be shorter than the rate!");
+        static_assert(kOut <= kRate8, "Digest must fit into one rate block!");
+        permute_and_store<kOut>(msg, kLen, digest);
+    }
+
+    template<size_t kOut = kDigest8>
+    static bool hash(const byte* msg, const size_t len, byte* digest) noexcept
+    {   // Runtime length; returns false if the message is too long
+        static_assert(kOut <= kRate8, "Digest must fit into one rate block!");
+        if (len >= kRate8 or (len and !msg))
+            return (false);
+        permute_and_store<kOut>(msg, len, digest);
+        return (true);
+    }
+
+    template<size_t kLen>
+    static std::array<byte, kDigest8> digest(const byte* msg) noexcept
+    {   // Wrapper function: the digest is returned by value
+        std::array<byte, kDigest8> res;
+        hash<kLen>(msg, res.data());
+        return (res);
+    }
+
+    template<size_t kOut = kDigest8>
+    static void iterate(const byte* seed, const size_t n, byte* digest) noexcept
+    {   // Hash chain H^n(seed): every step hashes the previous <kOut>-byte
+        // output (the seed is <kOut> bytes too). The chain value stays in
+        // the state lanes; the padding is rebuilt in place between steps.
+        static_assert(kOut < kRate8, "Chain value must be shorter than the rate!");
+        int_t st[kStateSize] = {};
+        std::memcpy(st, seed, kOut);
+        for (size_t i = 0; i < n; i++) {
+            for (int j = (kOut + kIntSize - 1) / kIntSize; j < kStateSize; j++)
+                st[j] = 0;
+            if (kOut % kIntSize)                // tail of the last chain lane
+                st[kOut / kIntSize] &= ~int_t(0) >> ((kIntSize - kOut % kIntSize) * k8Bits);
+            st[kOut / kIntSize] ^= static_cast<int_t>(kDom) << (kOut % kIntSize * k8Bits);
+            st[kRate8 / kIntSize - 1] ^= 0x8000000000000000ULL;
+            keccak_f_fast(st);
+        }
+        std::memcpy(digest, st, kOut);
+    }
+
+private:
+    template<size_t kOut>
+    static void permute_and_store(const byte* msg, const size_t len,
+                                  byte* digest) noexcept
+    {
+        int_t st[kStateSize] = {};
+        if (len)
+            std::memcpy(st, msg, len);          // message lanes
+        st[len / kIntSize] ^=                   // domain separation suffix
+            static_cast<int_t>(kDom) << (len % kIntSize * k8Bits);
+        st[kRate8 / kIntSize - 1] ^= 0x8000000000000000ULL; // last pad bit
+        keccak_f_fast(st);
+        std::memcpy(digest, st, kOut);          // digest lanes
+    }
+}; // end for struct OneBlock
+
+using OneBlockSHA3_224 = OneBlock<HashSize::kD_224>;
+using OneBlockSHA3_256 = OneBlock<HashSize::kD_256>;
+using OneBlockSHA3_384 = OneBlock<HashSize::kD_384>;
+using OneBlockSHA3_512 = OneBlock<HashSize::kD_512>;
+using OneBlockSHAKE128 = OneBlock<HashSize::kD_128, Domain::kDomSHAKE>;
+using OneBlockSHAKE256 = OneBlock<HashSize::kD_256, Domain::kDomSHAKE>;
+
+
+//====== Compile-time (constexpr) SHA3/SHAKE ======
+// The state is accessed only as lanes (no union, no reinterpret_cast),
+// so the whole sponge can be evaluated at compile time:
+//     constexpr auto id = chash::sha3_256("protocol v1");
+template<size_t N>
+struct ConstDigest {
+    byte data[N];
+    constexpr byte operator[](size_t i) const noexcept  {  return (data[i]);  }
+    constexpr size_t size() const noexcept  {  return (N);  }
+    constexpr const byte* begin() const noexcept  {  return (data);  }
+    constexpr const byte* end() const noexcept  {  return (data + N);  }
+};
+
+//-----------------------------------------------------------------------------
+constexpr void keccak_const(const char* msg, const size_t len,
+                            const size_t rate8, const int_t dom,
+                            byte* digest, const size_t digest_len) noexcept
+{   // Sponge over bytes: <rate8> - rate in bytes, <dom> - domain suffix
+    int_t st[kStateSize] = {};
+    size_t pos = 0;                             // position in the block
+    for (size_t i = 0; i < len; i++) {
+        st[pos / kIntSize] ^= static_cast<int_t>(static_cast<byte>(msg[i]))
+                              << (pos % kIntSize * k8Bits);
+        if (++pos == rate8) {
+            keccak_f(st);
+            pos = 0;
+        }
+    }
+    st[pos / kIntSize] ^= dom << (pos % kIntSize * k8Bits);
+    st[rate8 / kIntSize - 1] ^= 0x8000000000000000ULL;
+    keccak_f(st);
+    for (size_t i = 0, j = 0; i < digest_len; i++, j++) {
+        if (j == rate8) {
+            keccak_f(st);
+            j = 0;
+        }
+        digest[i] = static_cast<byte>(st[j / kIntSize] >> (j % kIntSize * k8Bits));
+    }
+} // end keccak_const(...)
+
+//-----------------------------------------------------------------------------
+template<size_t kOut>
+constexpr ConstDigest<kOut> keccak_const(const char* msg, const size_t len,
+                                         const HashSize hash_size,
+                                         const Domain dom) noexcept
+{
+    ConstDigest<kOut> res{};
+    keccak_const(msg, len,
+                 (kKeccakWidth - 2 * static_cast<size_t>(hash_size)) / k8Bits,
+                 static_cast<int_t>(dom), res.data, kOut);
+    return (res);
+} // end keccak_const(...)
+
+//------ constexpr wrappers: string literals and (pointer, length) ------
+template<size_t N>
+constexpr ConstDigest<28> sha3_224(const char (&str)[N]) noexcept
+{  return (keccak_const<28>(str, N - 1, HashSize::kD_224, Domain::kDomSHA3));  }
+template<size_t N>
+constexpr ConstDigest<32> sha3_256(const char (&str)[N]) noexcept
+{  return (keccak_const<32>(str, N - 1, HashSize::kD_256, Domain::kDomSHA3));  }
+template<size_t N>
+constexpr ConstDigest<48> sha3_384(const char (&str)[N]) noexcept
+{  return (keccak_const<48>(str, N - 1, HashSize::kD_384, Domain::kDomSHA3));  }
+template<size_t N>
+constexpr ConstDigest<64> sha3_512(const char (&str)[N]) noexcept
+{  return (keccak_const<64>(str, N - 1, HashSize::kD_512, Domain::kDomSHA3));  }
+template<size_t kOut, size_t N>
+constexpr ConstDigest<kOut> shake128(const char (&str)[N]) noexcept
+{  return (keccak_const<kOut>(str, N - 1, HashSize::kD_128, Domain::kDomSHAKE));  }
+template<size_t kOut, size_t N>
+constexpr ConstDigest<kOut> shake256(const char (&str)[N]) noexcept
+{  return (keccak_const<kOut>(str, N - 1, HashSize::kD_256, Domain::kDomSHAKE));  }
+
+constexpr ConstDigest<28> sha3_224(const char* msg, const size_t len) noexcept
+{  return (keccak_const<28>(msg, len, HashSize::kD_224, Domain::kDomSHA3));  }
+constexpr ConstDigest<32> sha3_256(const char* msg, const size_t len) noexcept
+{  return (keccak_const<32>(msg, len, HashSize::kD_256, Domain::kDomSHA3));  }
+constexpr ConstDigest<48> sha3_384(const char* msg, const size_t len) noexcept
+{  return (keccak_const<48>(msg, len, HashSize::kD_384, Domain::kDomSHA3));  }
+constexpr ConstDigest<64> sha3_512(const char* msg, const size_t len) noexcept
+{  return (keccak_const<64>(msg, len, HashSize::kD_512, Domain::kDomSHA3));  }
+template<size_t kOut>
+constexpr ConstDigest<kOut> shake128(const char* msg, const size_t len) noexcept
+{  return (keccak_const<kOut>(msg, len, HashSize::kD_128, Domain::kDomSHAKE));  }
+template<size_t kOut>
+constexpr ConstDigest<kOut> shake256(const char* msg, const size_t len) noexcept
+{  return (keccak_const<kOut>(msg, len, HashSize::kD_256, Domain::kDomSHAKE));  }
+
 //------ TYPES ALIASES ------
 using SHA3 = Keccak;
 using SHA3_IUF = IUFKeccak;
+using SHA3_Duplex = KeccakDuplex;
 using SHA3Param = KeccParam;
 
 } // end namespace "chash"
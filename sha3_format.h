@@ -0,0 +1,282 @@
+/******************************************************************************
+
+Copyright (c) 2022 Elijah Coleman
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef SHA3_FORMAT_H_
+#define SHA3_FORMAT_H_
+
+//-----------------------------------------------------------------------------
+// Digest output formatting for tools printing millions of digests:
+// table-driven hex (lower/upper case, optional byte separator) and base64
+// written straight into a caller buffer, a BufferedWriter collecting the
+// output in large blocks (no flush per line), and a compact binary manifest
+// (type, name, digest records) with its reader.
+
+#include "sha3_ec.h"
+
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace chash     // "cryptographic hash"
+{
+//====== Hex and base64 ======
+// Two characters per byte value, lower and upper case
+struct HexTable {
+    char lower[512];
+    char upper[512];
+    constexpr HexTable() : lower(), upper()
+    {
+        const char* lo = "0123456789abcdef";
+        const char* up = "0123456789ABCDEF";
+        for (int i = 0; i < 256; i++) {
+            lower[2 * i] = lo[i >> 4];
+            lower[2 * i + 1] = lo[i & 0x0F];
+            upper[2 * i] = up[i >> 4];
+            upper[2 * i + 1] = up[i & 0x0F];
+        }
+    }
+};
+static constexpr HexTable kHexTable{};
+
+static constexpr char kBase64Alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+//-------------------------------------------------------------------
+constexpr size_t hex_size(const size_t n, const char sep = 0) noexcept
+{   // Characters written by to_hex()
+    return (n ? 2 * n + (sep ? n - 1 : 0) : 0);
+} // end hex_size(...)
+
+//-----------------------------------------------------------------------------
+inline char* to_hex(const byte* p, const size_t n, char* out,
+                    const bool upper = false, const char sep = 0) noexcept
+{   // Returns the end of the written characters (no terminating zero)
+    const char* table = upper ? kHexTable.upper : kHexTable.lower;
+    for (size_t i = 0; i < n; i++) {
+        if (sep and i)
+            *out++ = sep;
+        std::memcpy(out, table + 2 * p[i], 2);
+        out += 2;
+    }
+    return (out);
+} // end to_hex(...)
+
+//-----------------------------------------------------------------------------
+inline std::string to_hex(const std::vector<byte>& digest,
+                          const bool upper = false, const char sep = 0)
+{   // Wrapper function
+    std::string res(hex_size(digest.size(), sep), '\0');
+    to_hex(digest.data(), digest.size(), &res[0], upper, sep);
+    return (res);
+} // end to_hex(...)
+
+//-------------------------------------------------------
+constexpr size_t base64_size(const size_t n) noexcept
+{   // Characters written by to_base64() (with the '=' padding)
+    return ((n + 2) / 3 * 4);
+} // end base64_size(...)
+
+//-----------------------------------------------------------------------------
+inline char* to_base64(const byte* p, const size_t n, char* out) noexcept
+{   // RFC 4648 alphabet, padded; returns the end of the written characters
+    size_t i = 0;
+    for (; i + 3 <= n; i += 3) {
+        unsigned v = (unsigned(p[i]) << 16) | (unsigned(p[i + 1]) << 8) | p[i + 2];
+        *out++ = kBase64Alphabet[v >> 18];
+        *out++ = kBase64Alphabet[(v >> 12) & 0x3F];
+        *out++ = kBase64Alphabet[(v >> 6) & 0x3F];
+        *out++ = kBase64Alphabet[v & 0x3F];
+    }
+    if (i < n) {
+        unsigned v = unsigned(p[i]) << 16;
+        if (i + 1 < n)
+            v |= unsigned(p[i + 1]) << 8;
+        *out++ = kBase64Alphabet[v >> 18];
+        *out++ = kBase64Alphabet[(v >> 12) & 0x3F];
+        *out++ = (i + 1 < n) ? kBase64Alphabet[(v >> 6) & 0x3F] : '=';
+        *out++ = '=';
+    }
+    return (out);
+} // end to_base64(...)
+
+//-----------------------------------------------------------
+inline std::string to_base64(const std::vector<byte>& digest)
+{   // Wrapper function
+    std::string res(base64_size(digest.size()), '\0');
+    to_base64(digest.data(), digest.size(), &res[0]);
+    return (res);
+} // end to_base64(...)
+
+//====== Buffered writer ======
+// The output is collected in a large block and written to the stream when
+// the block is full, by flush() or by the destructor. Not thread-safe.
+class BufferedWriter
+{
+public:
+    BufferedWriter(const BufferedWriter&) = delete;
+    BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+    explicit BufferedWriter(std::ostream& os, const size_t capacity = kDefaultCapacity)
+    :   os_(os), buf_(capacity ? capacity : 1), used_(0)
+    {}
+    ~BufferedWriter() {  flush();  }
+
+    //------ Main Interface ------
+    char* reserve(const size_t n);              // room for <n> characters
+    void commit(const size_t n) noexcept  {  used_ += n;  }
+    void write(const void* data, const size_t n);
+    void write(const std::string& str)  {  write(str.data(), str.size());  }
+    void put(const char c)  {  *reserve(1) = c;  commit(1);  }
+    void flush();                               // also flushes the stream
+    bool good() const  {  return (os_.good());  }
+
+    static constexpr size_t kDefaultCapacity = 1 << 20;     // bytes
+
+private:
+    void drain();
+
+    //------ Class Data Members ------
+    std::ostream&       os_;
+    std::vector<char>   buf_;
+    size_t              used_;      // buffered characters
+}; // end for class BufferedWriter declaration
+
+//-----------------------------------------
+inline void BufferedWriter::drain()
+{   // Write the buffered characters (the stream is not flushed)
+    if (used_)
+        os_.write(buf_.data(), static_cast<std::streamsize>(used_));
+    used_ = 0;
+} // end drain()
+
+//-----------------------------------------------
+inline char* BufferedWriter::reserve(const size_t n)
+{   // The pointer is valid up to the next call; commit() the characters
+    // actually written
+    if (used_ + n > buf_.size()) {
+        drain();
+        if (n > buf_.size())
+            buf_.resize(n);
+    }
+    return (buf_.data() + used_);
+} // end reserve(...)
+
+//-----------------------------------------------------------------
+inline void BufferedWriter::write(const void* data, const size_t n)
+{   // Large writes bypass the buffer
+    if (n >= buf_.size()) {
+        drain();
+        os_.write(static_cast<const char*>(data), static_cast<std::streamsize>(n));
+        return;
+    }
+    std::memcpy(reserve(n), data, n);
+    commit(n);
+} // end write(...)
+
+//-----------------------------------
+inline void BufferedWriter::flush()
+{
+    drain();
+    os_.flush();
+} // end flush()
+//====== end for class BufferedWriter definition ======
+
+//====== Binary manifest ======
+// Format (little-endian): magic "SHA3MAN1", then one record per digest:
+//   u8 type length | type ("SHA3-256"...) | u16 digest length (bytes) |
+//   u32 name length | name | digest
+static constexpr char kManifestMagic[8] = { 'S','H','A','3','M','A','N','1' };
+
+struct ManifestRecord {
+    std::string         type;
+    std::string         name;
+    std::vector<byte>   digest;
+};
+
+//-------------------------------------------------------
+inline void write_manifest_header(BufferedWriter& out)
+{
+    out.write(kManifestMagic, sizeof(kManifestMagic));
+} // end write_manifest_header(...)
+
+//-----------------------------------------------------------------------------
+inline void write_manifest_record(BufferedWriter& out, const std::string& type,
+                                  const std::string& name, const byte* digest,
+                                  const size_t size)
+{   // The type is cut to 255 characters, the digest to 65535 bytes
+    const size_t type_len = std::min<size_t>(type.size(), 0xFF);
+    const size_t digest_len = std::min<size_t>(size, 0xFFFF);
+    const size_t name_len = name.size();
+    char* p = out.reserve(1 + type_len + 2 + 4 + name_len + digest_len);
+    char* start = p;
+    *p++ = static_cast<char>(type_len);
+    std::memcpy(p, type.data(), type_len);
+    p += type_len;
+    for (int i = 0; i < 2; i++)
+        *p++ = static_cast<char>(digest_len >> (8 * i));
+    for (int i = 0; i < 4; i++)
+        *p++ = static_cast<char>(name_len >> (8 * i));
+    std::memcpy(p, name.data(), name_len);
+    p += name_len;
+    std::memcpy(p, digest, digest_len);
+    p += digest_len;
+    out.commit(p - start);
+} // end write_manifest_record(...)
+
+//-----------------------------------------------------------------
+inline bool read_manifest_header(std::istream& in)
+{   // false if the stream is not a manifest
+    char magic[sizeof(kManifestMagic)];
+    return (in.read(magic, sizeof(magic))
+            and !std::memcmp(magic, kManifestMagic, sizeof(magic)));
+} // end read_manifest_header(...)
+
+//-----------------------------------------------------------------------------
+inline bool read_manifest_record(std::istream& in, ManifestRecord& rec)
+{   // false at the end of the manifest (or if it is truncated)
+    unsigned char len[4];
+    if (!in.read(reinterpret_cast<char*>(len), 1))
+        return (false);
+    rec.type.resize(len[0]);
+    if (!in.read(&rec.type[0], static_cast<std::streamsize>(rec.type.size()))
+            or !in.read(reinterpret_cast<char*>(len), 2))
+        return (false);
+    rec.digest.resize(len[0] | (size_t(len[1]) << 8));
+    if (!in.read(reinterpret_cast<char*>(len), 4))
+        return (false);
+    rec.name.resize(len[0] | (size_t(len[1]) << 8) | (size_t(len[2]) << 16)
+                    | (size_t(len[3]) << 24));
+    return (in.read(&rec.name[0], static_cast<std::streamsize>(rec.name.size()))
+            and in.read(reinterpret_cast<char*>(rec.digest.data()),
+                        static_cast<std::streamsize>(rec.digest.size())));
+} // end read_manifest_record(...)
+//====== end for binary manifest ======
+
+} // end namespace "chash"
+
+//-----------------------------------------------------------------------------
+#endif /* SHA3_FORMAT_H_ */
@@ -0,0 +1,725 @@
+/******************************************************************************
+
+Copyright (c) 2022 Elijah Coleman
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef SHA3_MB_H_
+#define SHA3_MB_H_
+
+//-----------------------------------------------------------------------------
+// Multi-buffer KECCAK: N independent states are stored "lane by lane"
+// (st[lane][k] is the lane of the k-th state), so every step mapping is
+// applied to N lanes at once and the loops over <k> are vectorized by the
+// compiler.
+
+#include "sha3_ec.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace chash     // "cryptographic hash"
+{
+//------ Multi-buffer KECCAK-f[1600] ------
+template<size_t N>
+inline void keccak_f_mb(int_t (&st)[kStateSize][N]) noexcept
+{   // KECCAK-f[1600] over N interleaved states
+    for (int rc = 0; rc < kRounds; rc++) {
+        // THETA
+        int_t sht[5][N];
+        SHA3_UNROLL
+        for (int x = 0; x < 5; x++)
+            SHA3_UNROLL
+            for (size_t k = 0; k < N; k++)
+                sht[x][k] = st[x][k] ^ st[x+5][k] ^ st[x+10][k]
+                          ^ st[x+15][k] ^ st[x+20][k];
+        SHA3_UNROLL
+        for (int x = 0; x < 5; x++)
+            SHA3_UNROLL
+            for (size_t k = 0; k < N; k++) {
+                int_t d = sht[(x+4)%5][k] ^ rotl(sht[(x+1)%5][k], 1);
+                SHA3_UNROLL
+                for (int y = 0; y < kStateSize; y += 5)
+                    st[x+y][k] ^= d;
+            }
+        // RHO & PI
+        int_t tmp[kStateSize][N];
+        SHA3_UNROLL
+        for (int x = 0; x < 5; x++)
+            SHA3_UNROLL
+            for (int y = 0; y < 5; y++)
+                SHA3_UNROLL
+                for (size_t k = 0; k < N; k++)
+                    tmp[y + ((2*x + 3*y) % 5)*5][k] =
+                        rotl(st[x + y*5][k], kRhoOffset[x + y*5]);
+        // CHI
+        SHA3_UNROLL
+        for (int y = 0; y < kStateSize; y += 5)
+            SHA3_UNROLL
+            for (int x = 0; x < 5; x++)
+                SHA3_UNROLL
+                for (size_t k = 0; k < N; k++)
+                    st[y+x][k] = tmp[y+x][k]
+                            ^ (~tmp[y+(x+1)%5][k] & tmp[y+(x+2)%5][k]);
+        // IOTA
+        SHA3_UNROLL
+        for (size_t k = 0; k < N; k++)
+            st[0][k] ^= kIotaRc[rc];
+    } // end for(rc...)
+} // end keccak_f_mb(...)
+
+#if defined(__AVX2__)
+//------------------------------------------------------------------------
+template<>
+inline void keccak_f_mb<4>(int_t (&st)[kStateSize][4]) noexcept
+{   // 4-way KECCAK-f[1600] on AVX2: one 256-bit register holds one lane
+    // of each of the four states
+    __m256i a[kStateSize], b[kStateSize], c[5], d[5];
+    SHA3_UNROLL
+    for (int i = 0; i < kStateSize; i++)
+        a[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(st[i]));
+    auto rol = [](__m256i v, int r) {    // r == 0: right shift by 64 gives 0
+        return (_mm256_or_si256(_mm256_slli_epi64(v, r),
+                                _mm256_srli_epi64(v, 64 - r)));
+    };
+    for (int rc = 0; rc < kRounds; rc++) {
+        // THETA
+        SHA3_UNROLL
+        for (int x = 0; x < 5; x++)
+            c[x] = _mm256_xor_si256(_mm256_xor_si256(a[x], a[x+5]),
+                   _mm256_xor_si256(_mm256_xor_si256(a[x+10], a[x+15]), a[x+20]));
+        SHA3_UNROLL
+        for (int x = 0; x < 5; x++)
+            d[x] = _mm256_xor_si256(c[(x+4)%5], rol(c[(x+1)%5], 1));
+        // THETA (apply), RHO & PI
+        SHA3_UNROLL
+        for (int x = 0; x < 5; x++)
+            SHA3_UNROLL
+            for (int y = 0; y < 5; y++)
+                b[y + ((2*x + 3*y) % 5)*5] = rol(
+                    _mm256_xor_si256(a[x + y*5], d[x]),
+                    static_cast<int>(kRhoOffset[x + y*5]));
+        // CHI
+        SHA3_UNROLL
+        for (int y = 0; y < kStateSize; y += 5)
+            SHA3_UNROLL
+            for (int x = 0; x < 5; x++)
+                a[y+x] = _mm256_xor_si256(b[y+x],
+                         _mm256_andnot_si256(b[y+(x+1)%5], b[y+(x+2)%5]));
+        // IOTA
+        a[0] = _mm256_xor_si256(a[0],
+               _mm256_set1_epi64x(static_cast<long long>(kIotaRc[rc])));
+    } // end for(rc...)
+    SHA3_UNROLL
+    for (int i = 0; i < kStateSize; i++)
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(st[i]), a[i]);
+} // end keccak_f_mb<4>(...)
+#endif  // __AVX2__
+
+#if defined(__AVX512F__)
+//------------------------------------------------------------------------
+template<>
+inline void keccak_f_mb<8>(int_t (&st)[kStateSize][8]) noexcept
+{   // 8-way KECCAK-f[1600] on AVX-512: native rotations, CHI in one
+    // ternary logic instruction (0xD2: a ^ (~b & c))
+    __m512i a[kStateSize], b[kStateSize], c[5], d[5];
+    SHA3_UNROLL
+    for (int i = 0; i < kStateSize; i++)
+        a[i] = _mm512_loadu_si512(st[i]);
+    for (int rc = 0; rc < kRounds; rc++) {
+        // THETA
+        SHA3_UNROLL
+        for (int x = 0; x < 5; x++)
+            c[x] = _mm512_xor_si512(_mm512_ternarylogic_epi64(
+                   a[x], a[x+5], a[x+10], 0x96),            // a ^ b ^ c
+                   _mm512_xor_si512(a[x+15], a[x+20]));
+        SHA3_UNROLL
+        for (int x = 0; x < 5; x++)
+            d[x] = _mm512_xor_si512(c[(x+4)%5], _mm512_rol_epi64(c[(x+1)%5], 1));
+        // THETA (apply), RHO & PI
+        SHA3_UNROLL
+        for (int x = 0; x < 5; x++)
+            SHA3_UNROLL
+            for (int y = 0; y < 5; y++)
+                b[y + ((2*x + 3*y) % 5)*5] = _mm512_rolv_epi64(
+                    _mm512_xor_si512(a[x + y*5], d[x]),
+                    _mm512_set1_epi64(static_cast<long long>(kRhoOffset[x + y*5])));
+        // CHI
+        SHA3_UNROLL
+        for (int y = 0; y < kStateSize; y += 5)
+            SHA3_UNROLL
+            for (int x = 0; x < 5; x++)
+                a[y+x] = _mm512_ternarylogic_epi64(b[y+x], b[y+(x+1)%5],
+                                                   b[y+(x+2)%5], 0xD2);
+        // IOTA
+        a[0] = _mm512_xor_si512(a[0],
+               _mm512_set1_epi64(static_cast<long long>(kIotaRc[rc])));
+    } // end for(rc...)
+    SHA3_UNROLL
+    for (int i = 0; i < kStateSize; i++)
+        _mm512_storeu_si512(st[i], a[i]);
+} // end keccak_f_mb<8>(...)
+#endif  // __AVX512F__
+
+#if defined(__SSE2__)
+//------------------------------------------------------------------------
+inline void keccak_f_x2(int_t (&st)[kStateSize][2]) noexcept
+{   // Two states, every step interleaved: one 128-bit register holds one
+    // lane of both states (SSE2 is the x86-64 baseline). The scalar form
+    // below needs 2 x 25 lanes plus temporaries in 16 registers and gains
+    // nothing over two keccak_f_fast() calls; see bench/permute_bench.cpp.
+    __m128i a[kStateSize], b[kStateSize], c[5], d[5];
+    SHA3_UNROLL
+    for (int i = 0; i < kStateSize; i++)
+        a[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(st[i]));
+    auto rol = [](__m128i v, int r) {    // r == 0: right shift by 64 gives 0
+        return (_mm_or_si128(_mm_slli_epi64(v, r), _mm_srli_epi64(v, 64 - r)));
+    };
+    for (int rc = 0; rc < kRounds; rc++) {
+        // THETA
+        SHA3_UNROLL
+        for (int x = 0; x < 5; x++)
+            c[x] = _mm_xor_si128(_mm_xor_si128(a[x], a[x+5]),
+                   _mm_xor_si128(_mm_xor_si128(a[x+10], a[x+15]), a[x+20]));
+        SHA3_UNROLL
+        for (int x = 0; x < 5; x++)
+            d[x] = _mm_xor_si128(c[(x+4)%5], rol(c[(x+1)%5], 1));
+        // THETA (apply), RHO & PI
+        SHA3_UNROLL
+        for (int x = 0; x < 5; x++)
+            SHA3_UNROLL
+            for (int y = 0; y < 5; y++)
+                b[y + ((2*x + 3*y) % 5)*5] = rol(
+                    _mm_xor_si128(a[x + y*5], d[x]),
+                    static_cast<int>(kRhoOffset[x + y*5]));
+        // CHI
+        SHA3_UNROLL
+        for (int y = 0; y < kStateSize; y += 5)
+            SHA3_UNROLL
+            for (int x = 0; x < 5; x++)
+                a[y+x] = _mm_xor_si128(b[y+x],
+                         _mm_andnot_si128(b[y+(x+1)%5], b[y+(x+2)%5]));
+        // IOTA
+        a[0] = _mm_xor_si128(a[0],
+               _mm_set1_epi64x(static_cast<long long>(kIotaRc[rc])));
+    } // end for(rc...)
+    SHA3_UNROLL
+    for (int i = 0; i < kStateSize; i++)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(st[i]), a[i]);
+} // end keccak_f_x2(...)
+#else
+//------------------------------------------------------------------------
+inline void keccak_f_x2(int_t (&st)[kStateSize][2]) noexcept
+{   // Two states in interleaved scalar instruction streams (no SSE2): the
+    // independent dependency chains keep more ports busy
+    int_t a[kStateSize], b[kStateSize];     // the 1st and the 2nd state
+    SHA3_UNROLL
+    for (int i = 0; i < kStateSize; i++) {
+        a[i] = st[i][0];
+        b[i] = st[i][1];
+    }
+    for (int rc = 0; rc < kRounds; rc++) {
+        int_t ca[5], cb[5], ta[kStateSize], tb[kStateSize];
+        // THETA
+        SHA3_UNROLL
+        for (int x = 0; x < 5; x++) {
+            ca[x] = a[x] ^ a[x+5] ^ a[x+10] ^ a[x+15] ^ a[x+20];
+            cb[x] = b[x] ^ b[x+5] ^ b[x+10] ^ b[x+15] ^ b[x+20];
+        }
+        // THETA (apply), RHO & PI
+        SHA3_UNROLL
+        for (int x = 0; x < 5; x++) {
+            int_t da = ca[(x+4)%5] ^ rotl(ca[(x+1)%5], 1);
+            int_t db = cb[(x+4)%5] ^ rotl(cb[(x+1)%5], 1);
+            SHA3_UNROLL
+            for (int y = 0; y < 5; y++) {
+                ta[y + ((2*x + 3*y) % 5)*5] = rotl(a[x + y*5] ^ da, kRhoOffset[x + y*5]);
+                tb[y + ((2*x + 3*y) % 5)*5] = rotl(b[x + y*5] ^ db, kRhoOffset[x + y*5]);
+            }
+        }
+        // CHI
+        SHA3_UNROLL
+        for (int y = 0; y < kStateSize; y += 5)
+            SHA3_UNROLL
+            for (int x = 0; x < 5; x++) {
+                a[y+x] = ta[y+x] ^ (~ta[y+(x+1)%5] & ta[y+(x+2)%5]);
+                b[y+x] = tb[y+x] ^ (~tb[y+(x+1)%5] & tb[y+(x+2)%5]);
+            }
+        // IOTA
+        a[0] ^= kIotaRc[rc];
+        b[0] ^= kIotaRc[rc];
+    } // end for(rc...)
+    SHA3_UNROLL
+    for (int i = 0; i < kStateSize; i++) {
+        st[i][0] = a[i];
+        st[i][1] = b[i];
+    }
+} // end keccak_f_x2(...)
+#endif  // __SSE2__
+
+//------------------------------------------------------------------------
+template<>
+inline void keccak_f_mb<1>(int_t (&st)[kStateSize][1]) noexcept
+{   // A single state: the layout is the same as int_t[kStateSize]
+    keccak_f_fast(&st[0][0]);
+} // end keccak_f_mb<1>(...)
+
+// Number of states processed by one multi-buffer call at the native
+// vector width (the generic kernel is used for any other N)
+#if defined(__AVX512F__)
+static const size_t kMBWays = 8;
+#else
+static const size_t kMBWays = 4;
+#endif
+
+//====== Multi-message API ======
+// Backends of the multi-message kernel
+enum class Backend {
+    kAuto,          // the widest one available
+    kScalar,        // one state, keccak_f_fast()
+    kInterleaved,   // two states interleaved, keccak_f_x2 (SSE2 or scalar)
+    kAVX2,          // four states, keccak_f_mb<4> on AVX2
+    kAVX512         // eight states, keccak_f_mb<8> on AVX-512
+};
+
+//----------------------------------------------------------
+inline bool backend_available(Backend backend) noexcept
+{   // Selected at compile time (-mavx2, -mavx512f, -march=native...)
+    switch (backend) {
+#if defined(__AVX2__)
+    case Backend::kAVX2:
+        return (true);
+#endif
+#if defined(__AVX512F__)
+    case Backend::kAVX512:
+        return (true);
+#endif
+    case Backend::kAuto:
+    case Backend::kScalar:
+    case Backend::kInterleaved:
+        return (true);
+    default:
+        return (false);
+    }
+} // end backend_available(...)
+
+//----------------------------------------------------------
+inline Backend best_backend() noexcept
+{
+#if defined(__AVX512F__)
+    return (Backend::kAVX512);
+#elif defined(__AVX2__)
+    return (Backend::kAVX2);
+#else
+    return (Backend::kInterleaved);
+#endif
+} // end best_backend()
+
+//----------------------------------------------------------
+inline const char* backend_name(Backend backend) noexcept
+{
+    switch (backend) {
+    case Backend::kScalar:      return ("scalar");
+    case Backend::kInterleaved: return ("interleaved");
+    case Backend::kAVX2:        return ("AVX2");
+    case Backend::kAVX512:      return ("AVX-512");
+    default:                    return ("auto");
+    }
+} // end backend_name(...)
+
+//-----------------------------------------------------------------------------
+template<size_t W>
+inline void permute_group(int_t (&st)[kStateSize][W], Backend backend) noexcept
+{   // Dispatch of one lockstep step to the selected kernel
+    if (Backend::kInterleaved == backend and 0 == W % 2) {
+        for (size_t k = 0; k < W; k += 2) {
+            int_t pair[kStateSize][2];
+            for (int i = 0; i < kStateSize; i++) {
+                pair[i][0] = st[i][k];
+                pair[i][1] = st[i][k + 1];
+            }
+            keccak_f_x2(pair);
+            for (int i = 0; i < kStateSize; i++) {
+                st[i][k] = pair[i][0];
+                st[i][k + 1] = pair[i][1];
+            }
+        }
+    }
+    else
+        keccak_f_mb(st);
+} // end permute_group(...)
+
+//-----------------------------------------------------------------------------
+template<size_t W>
+inline void hash_group(const size_t rate8, const int_t dom,
+                       const char* const msgs[], const size_t lens[],
+                       byte* const digests[], const size_t count,
+                       const size_t digest_bits, Backend backend) noexcept
+{   // Up to W messages absorbed in lockstep. A message that needs fewer
+    // blocks is squeezed right after its last block; the lane then idles.
+    int_t st[kStateSize][W] = {};
+    size_t blocks[W] = {};                  // padded blocks per message
+    size_t steps = 0;
+    for (size_t k = 0; k < count; k++) {
+        blocks[k] = lens[k] / rate8 + 1;
+        steps = std::max(steps, blocks[k]);
+    }
+    const size_t digest8 = (digest_bits + k8Bits - 1) / k8Bits;
+    for (size_t step = 0; step < steps; step++) {
+        for (size_t k = 0; k < count; k++) {
+            if (step >= blocks[k])
+                continue;
+            const byte* cur = reinterpret_cast<const byte*>(msgs[k]) + step * rate8;
+            if (step + 1 < blocks[k]) {         // whole block by lanes
+                for (size_t i = 0; i < rate8 / kIntSize; i++) {
+                    int_t lane;
+                    std::memcpy(&lane, cur + i * kIntSize, kIntSize);
+                    st[i][k] ^= lane;
+                }
+                continue;
+            }
+            byte block[kKeccakWidth / k8Bits] = {}; // last (padded) block
+            size_t tail = lens[k] - step * rate8;
+            if (tail)
+                std::memcpy(block, cur, tail);
+            block[tail] ^= static_cast<byte>(dom);
+            block[rate8 - 1] ^= 0x80;
+            for (size_t i = 0; i < rate8 / kIntSize; i++) {
+                int_t lane;
+                std::memcpy(&lane, block + i * kIntSize, kIntSize);
+                st[i][k] ^= lane;
+            }
+        }
+        permute_group(st, backend);
+        for (size_t k = 0; k < count; k++) {
+            if (step + 1 != blocks[k])
+                continue;
+            // Squeezing: the first block from the group state, the rest
+            // (long SHAKE outputs) by the scalar permutation
+            int_t lanes[kStateSize];
+            for (int i = 0; i < kStateSize; i++)
+                lanes[i] = st[i][k];
+            for (size_t done = 0; done < digest8; ) {
+                size_t block = std::min(digest8 - done, rate8);
+                std::memcpy(digests[k] + done, lanes, block);
+                done += block;
+                if (done < digest8)
+                    keccak_f_fast(lanes);
+            }
+            if (digest_bits % k8Bits)
+                digests[k][digest8 - 1] &= 0xFF >> (k8Bits - digest_bits % k8Bits);
+        }
+    } // end for(step...)
+} // end hash_group(...)
+
+//-----------------------------------------------------------------------------
+inline void hash_many(const KeccParam& param, const char* const msgs[],
+                      const size_t lens[], byte* const digests[],
+                      const size_t count, size_t digest_bits = 0,
+                      Backend backend = Backend::kAuto)
+{   // Digests of <count> independent messages (digests[i] must hold
+    // ceil(digest_bits / 8) bytes; digest_bits == 0 - the default size of
+    // <param>). Messages are sorted by length, so that the messages hashed
+    // in lockstep need the same number of blocks.
+    const size_t hash_size = static_cast<size_t>(param.hash_size);
+    const size_t rate8 = (kKeccakWidth - 2 * hash_size) / k8Bits;
+    const int_t dom = static_cast<int_t>(param.dom);
+    if (!digest_bits or Domain::kDomSHA3 == param.dom)
+        digest_bits = hash_size;
+    if (Backend::kAuto == backend or !backend_available(backend))
+        backend = best_backend();
+    const size_t width = (Backend::kAVX512 == backend) ? 8 :
+                         (Backend::kAVX2 == backend) ? 4 :
+                         (Backend::kInterleaved == backend) ? 2 : 1;
+
+    std::vector<size_t> order(count);
+    std::iota(order.begin(), order.end(), size_t(0));
+    std::stable_sort(order.begin(), order.end(),
+        [&](size_t a, size_t b) {  return (lens[a] / rate8 < lens[b] / rate8);  });
+    for (size_t first = 0; first < count; first += width) {
+        const char* g_msgs[8];
+        size_t g_lens[8];
+        byte* g_digests[8];
+        size_t n = std::min(width, count - first);
+        for (size_t k = 0; k < n; k++) {
+            g_msgs[k] = msgs[order[first + k]];
+            g_lens[k] = lens[order[first + k]];
+            g_digests[k] = digests[order[first + k]];
+        }
+        switch (width) {
+        case 8:
+            hash_group<8>(rate8, dom, g_msgs, g_lens, g_digests, n, digest_bits, backend);
+            break;
+        case 4:
+            hash_group<4>(rate8, dom, g_msgs, g_lens, g_digests, n, digest_bits, backend);
+            break;
+        case 2:
+            hash_group<2>(rate8, dom, g_msgs, g_lens, g_digests, n, digest_bits, backend);
+            break;
+        default:
+            hash_group<1>(rate8, dom, g_msgs, g_lens, g_digests, n, digest_bits, backend);
+        }
+    }
+} // end hash_many(...)
+
+//-----------------------------------------------------------------------------
+template<size_t W>
+inline void iterate_group(const size_t rate8, const int_t dom,
+                          const byte* const seeds[], byte* const out[],
+                          const size_t count, const size_t n,
+                          const size_t out8, Backend backend) noexcept
+{   // Up to W hash chains of the same length advanced in lockstep; each
+    // step rebuilds the one-block padding around the chain lanes
+    int_t st[kStateSize][W] = {};
+    for (size_t k = 0; k < count; k++)
+        for (size_t i = 0; i < out8; i++)
+            st[i / kIntSize][k] |= static_cast<int_t>(seeds[k][i])
+                                   << (i % kIntSize * k8Bits);
+    const size_t lanes = (out8 + kIntSize - 1) / kIntSize;
+    const int_t mask = (out8 % kIntSize) ?
+        ~int_t(0) >> ((kIntSize - out8 % kIntSize) * k8Bits) : ~int_t(0);
+    for (size_t step = 0; step < n; step++) {
+        for (int i = static_cast<int>(lanes); i < kStateSize; i++)
+            for (size_t k = 0; k < W; k++)
+                st[i][k] = 0;
+        for (size_t k = 0; k < W; k++) {
+            st[lanes - 1][k] &= mask;
+            st[out8 / kIntSize][k] ^= dom << (out8 % kIntSize * k8Bits);
+            st[rate8 / kIntSize - 1][k] ^= 0x8000000000000000ULL;
+        }
+        permute_group(st, backend);
+    }
+    for (size_t k = 0; k < count; k++)
+        for (size_t i = 0; i < out8; i++)
+            out[k][i] = static_cast<byte>(st[i / kIntSize][k] >> (i % kIntSize * k8Bits));
+} // end iterate_group(...)
+
+//-----------------------------------------------------------------------------
+inline bool iterate_many(const KeccParam& param, const byte* const seeds[],
+                         byte* const out[], const size_t count, const size_t n,
+                         size_t out_len = 0, Backend backend = Backend::kAuto)
+{   // <count> independent hash chains: out[k] = H^n(seeds[k]), where every
+    // step hashes the previous <out_len>-byte output (out_len == 0 - the
+    // digest size of <param>; SHA3 always uses its digest size). The chain
+    // value must be shorter than the rate; returns false otherwise.
+    const size_t hash_size = static_cast<size_t>(param.hash_size);
+    const size_t rate8 = (kKeccakWidth - 2 * hash_size) / k8Bits;
+    if (!out_len or Domain::kDomSHA3 == param.dom)
+        out_len = hash_size / k8Bits;
+    if (!out_len or out_len >= rate8)
+        return (false);
+    if (Backend::kAuto == backend or !backend_available(backend))
+        backend = best_backend();
+    const size_t width = (Backend::kAVX512 == backend) ? 8 :
+                         (Backend::kAVX2 == backend) ? 4 :
+                         (Backend::kInterleaved == backend) ? 2 : 1;
+    const int_t dom = static_cast<int_t>(param.dom);
+    for (size_t first = 0; first < count; first += width) {
+        size_t n_group = std::min(width, count - first);
+        switch (width) {
+        case 8:
+            iterate_group<8>(rate8, dom, seeds + first, out + first, n_group,
+                             n, out_len, backend);
+            break;
+        case 4:
+            iterate_group<4>(rate8, dom, seeds + first, out + first, n_group,
+                             n, out_len, backend);
+            break;
+        case 2:
+            iterate_group<2>(rate8, dom, seeds + first, out + first, n_group,
+                             n, out_len, backend);
+            break;
+        default:
+            iterate_group<1>(rate8, dom, seeds + first, out + first, n_group,
+                             n, out_len, backend);
+        }
+    }
+    return (true);
+} // end iterate_many(...)
+
+//------------------------------------------------------------------
+template<size_t N>
+inline void sha3_256_node_mb(const byte prefix, const byte* const in[N],
+                             byte* const out[N]) noexcept
+{   // SHA3-256 of N messages <prefix> || 64 bytes (one block, i.e. one
+    // permutation per message): Merkle tree interior nodes
+    static const size_t kRateLanes = 17;     // (1600 - 2 * 256) / 64
+    int_t st[kStateSize][N] = {};
+    for (size_t k = 0; k < N; k++) {
+        byte block[9 * kIntSize] = {};       // 65 bytes and the suffix
+        block[0] = prefix;
+        std::memcpy(block + 1, in[k], 64);
+        block[65] = static_cast<byte>(Domain::kDomSHA3);
+        for (size_t i = 0; i < 9; i++)
+            std::memcpy(&st[i][k], block + i * kIntSize, kIntSize);
+        st[kRateLanes - 1][k] = 0x8000000000000000ULL;
+    }
+    keccak_f_mb(st);
+    for (size_t k = 0; k < N; k++)
+        for (size_t i = 0; i < 4; i++)
+            std::memcpy(out[k] + i * kIntSize, &st[i][k], kIntSize);
+} // end sha3_256_node_mb(...)
+
+
+//====== Multi-buffer SHAKE ======
+// N independent SHAKE128/256 states absorbed, finalized and squeezed in
+// lockstep (bulk XOF expansion, e.g. seed || i || j streams). All messages
+// passed to one absorb() call must have the same length. Once finalized
+// (explicitly or by the first squeeze()) absorb() and finalize() are
+// ignored; init() restarts the sponge.
+template<size_t N>
+class ShakeMB
+{
+public:
+    explicit ShakeMB(const KeccParam& param = kSHAKE128)
+    :   rate8_((kKeccakWidth - 2 * static_cast<size_t>(param.hash_size)) / k8Bits)
+    {  init();  }
+
+    //------ Main Interface ------
+    void init() noexcept;
+    void absorb(const byte* const in[N], const size_t len) noexcept;
+    void finalize() noexcept;
+    void squeeze(byte* const out[N], const size_t len) noexcept;
+
+    size_t get_rate() const noexcept  {  return (rate8_ * k8Bits);  }
+
+private:
+    void xor_byte(size_t k, size_t pos, byte val) noexcept
+    {   st_[pos / kIntSize][k] ^= static_cast<int_t>(val) << (pos % kIntSize * k8Bits);  }
+
+    //------ Class Data Members ------
+    alignas(64) int_t st_[kStateSize][N];
+    size_t rate8_;      // rate in bytes
+    size_t pos_;        // position in the current block (absorbing/squeezing)
+    bool squeezing_;
+}; // end for class ShakeMB declaration
+
+//--------------------------------------------
+template<size_t N>
+inline void ShakeMB<N>::init() noexcept
+{
+    std::memset(st_, 0, sizeof(st_));
+    pos_ = 0;
+    squeezing_ = false;
+} // end init()
+
+//-----------------------------------------------------------------------------
+template<size_t N>
+inline void ShakeMB<N>::absorb(const byte* const in[N], const size_t len) noexcept
+{   // The k-th message goes to the k-th state (ignored while squeezing)
+    if (squeezing_)
+        return;
+    for (size_t done = 0; done < len; ) {
+        size_t block = std::min<size_t>(len - done, rate8_ - pos_);
+        if (!pos_ and block == rate8_) {    // whole block by lanes
+            for (size_t k = 0; k < N; k++)
+                for (size_t i = 0; i < rate8_ / kIntSize; i++) {
+                    int_t lane;
+                    std::memcpy(&lane, in[k] + done + i * kIntSize, kIntSize);
+                    st_[i][k] ^= lane;
+                }
+        }
+        else {
+            for (size_t k = 0; k < N; k++)
+                for (size_t i = 0; i < block; i++)
+                    xor_byte(k, pos_ + i, in[k][done + i]);
+        }
+        pos_ += block;
+        done += block;
+        if (pos_ == rate8_) {
+            keccak_f_mb(st_);
+            pos_ = 0;
+        }
+    }
+} // end absorb(...)
+
+//------------------------------------------------
+template<size_t N>
+inline void ShakeMB<N>::finalize() noexcept
+{   // Domain separation and padding of all states, then one permutation
+    if (squeezing_)
+        return;                         // already finalized
+    for (size_t k = 0; k < N; k++) {
+        xor_byte(k, pos_, static_cast<byte>(Domain::kDomSHAKE));
+        xor_byte(k, rate8_ - 1, 0x80);
+    }
+    keccak_f_mb(st_);
+    pos_ = 0;
+    squeezing_ = true;
+} // end finalize()
+
+//-----------------------------------------------------------------------------
+template<size_t N>
+inline void ShakeMB<N>::squeeze(byte* const out[N], const size_t len) noexcept
+{   // Next <len> bytes of every stream; may be called repeatedly
+    if (!squeezing_)
+        finalize();
+    for (size_t done = 0; done < len; ) {
+        if (pos_ == rate8_) {
+            keccak_f_mb(st_);
+            pos_ = 0;
+        }
+        size_t block = std::min<size_t>(len - done, rate8_ - pos_);
+        if (!(pos_ % kIntSize) and !(block % kIntSize)) {   // by lanes
+            for (size_t k = 0; k < N; k++)
+                for (size_t i = 0; i < block / kIntSize; i++)
+                    std::memcpy(out[k] + done + i * kIntSize,
+                                &st_[pos_ / kIntSize + i][k], kIntSize);
+        }
+        else {
+            for (size_t k = 0; k < N; k++)
+                for (size_t i = 0; i < block; i++) {
+                    size_t pos = pos_ + i;
+                    out[k][done + i] = static_cast<byte>(
+                        st_[pos / kIntSize][k] >> (pos % kIntSize * k8Bits));
+                }
+        }
+        pos_ += block;
+        done += block;
+    }
+} // end squeeze(...)
+
+//====== end for class ShakeMB definition ======
+
+//-----------------------------------------------------------------------------
+template<size_t N>
+inline void shake_mb(const KeccParam& param, const byte* const in[N],
+                     const size_t in_len, byte* const out[N],
+                     const size_t out_len) noexcept
+{   // One-shot: N equal-length messages, N outputs of <out_len> bytes
+    ShakeMB<N> sponge(param);
+    sponge.absorb(in, in_len);
+    sponge.squeeze(out, out_len);
+} // end shake_mb(...)
+
+} // end namespace "chash"
+
+//-----------------------------------------------------------------------------
+#endif /* SHA3_MB_H_ */
@@ -0,0 +1,336 @@
+/******************************************************************************
+
+Copyright (c) 2022 Elijah Coleman
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef SHA3_MERKLE_H_
+#define SHA3_MERKLE_H_
+
+//-----------------------------------------------------------------------------
+// Merkle tree over SHA3-256, leaves and nodes are domain separated as in
+// RFC 6962 (a node can not be presented as a leaf and vice versa):
+//   leaf = SHA3-256(0x00 || data)
+//   node = SHA3-256(0x01 || left || right)   (65 bytes - exactly one
+//                                             permutation, see OneBlock)
+// A node without a right sibling is promoted to the next level unchanged.
+// Requires C++17 and linking with the threads library (-pthread).
+
+#include "sha3_ec.h"
+#include "sha3_mb.h"
+
+#include <array>
+#include <vector>
+#include <string>
+#include <thread>
+#include <cstring>
+#include <stdexcept>
+
+namespace chash     // "cryptographic hash"
+{
+//------ TYPES ALIASES ------
+using Digest256 = std::array<byte, 32>;
+
+static_assert(sizeof(Digest256) == 32, "Digest256 must not be padded!");
+
+//------ Inclusion proof ------
+struct MerkleProof {
+    size_t index = 0;                   // leaf index
+    size_t leaf_count = 0;              // number of leaves in the tree
+    std::vector<Digest256> path;        // sibling hashes from leaves to root
+};
+
+//====== Merkle tree builder ======
+class MerkleTree
+{
+public:
+    explicit MerkleTree(unsigned threads = 0);
+
+    //------ Main Interface ------
+    void build(const std::vector<std::string>& leaves);
+    void build(std::vector<Digest256> leaf_digests);
+    void update(size_t index, const char* data, const size_t size);
+    void update(size_t index, const std::string& data);
+    void update(size_t index, const Digest256& leaf_digest);
+    Digest256 root() const;
+    MerkleProof get_proof(size_t index) const;
+    static bool verify(const Digest256& root, const Digest256& leaf_digest,
+                       const MerkleProof& proof) noexcept;
+
+    size_t leaf_count() const noexcept
+    {  return (levels_.empty() ? 0 : levels_.front().size());  }
+
+    //------ Hash primitives ------
+    static const byte kLeafPrefix = 0x00;
+    static const byte kNodePrefix = 0x01;
+    static Digest256 hash_leaf(const char* data, const size_t size) noexcept;
+    static Digest256 hash_node(const Digest256& left,
+                               const Digest256& right) noexcept;
+
+private:
+    void build_levels();
+    void hash_level(const std::vector<Digest256>& src,
+                    std::vector<Digest256>& dst, size_t from, size_t to) const;
+    template<typename Func>
+    void run_parallel(size_t count, Func func) const;
+
+    //------ Class Data Members ------
+    static const size_t kBatch = 4;             // nodes per multi-buffer call
+    static const size_t kLeafBatch = 64;        // leaves per hash_many() call
+    static const size_t kMinPerThread = 4096;   // nodes per worker thread
+    unsigned threads_;
+    std::vector<std::vector<Digest256>> levels_;  // [0] - leaves, back - root
+}; // end for class MerkleTree declaration
+
+//------------------------------------------------
+inline MerkleTree::MerkleTree(unsigned threads)
+:   threads_(threads ? threads : std::thread::hardware_concurrency())
+{
+    if (!threads_)
+        threads_ = 1;
+} // end MerkleTree::MerkleTree(...)
+
+//-----------------------------------------------------------------------------
+inline Digest256 MerkleTree::hash_leaf(const char* data,
+                                       const size_t size) noexcept
+{   // SHA3-256(0x00 || data) into a fixed-size digest (no heap allocation)
+    static const size_t kRate8 = OneBlockSHA3_256::kRate8;
+    const byte* cur = reinterpret_cast<const byte*>(data);
+    size_t left = data ? size : 0;
+    int_t st[kStateSize] = {};
+    auto absorb = [&st](const byte* block) {
+        for (size_t i = 0; i < kRate8 / kIntSize; i++) {
+            int_t lane;
+            std::memcpy(&lane, block + i * kIntSize, kIntSize);
+            st[i] ^= lane;
+        }
+        keccak_f_fast(st);
+    };
+    byte block[kRate8];                         // the prefix shifts the data,
+    block[0] = kLeafPrefix;                     // so the blocks are copied
+    size_t fill = 1;
+    for (;;) {
+        size_t take = std::min(left, kRate8 - fill);
+        if (take)
+            std::memcpy(block + fill, cur, take);
+        cur += take;
+        left -= take;
+        fill += take;
+        if (fill < kRate8)
+            break;                              // last (partial) block
+        absorb(block);
+        fill = 0;
+    }
+    std::memset(block + fill, 0, kRate8 - fill);
+    block[fill] ^= static_cast<byte>(Domain::kDomSHA3);
+    block[kRate8 - 1] ^= 0x80;
+    absorb(block);
+    Digest256 digest;
+    std::memcpy(digest.data(), st, digest.size());
+    return (digest);
+} // end hash_leaf(...)
+
+//-------------------------------------------------------------------
+inline Digest256 MerkleTree::hash_node(const Digest256& left,
+                                       const Digest256& right) noexcept
+{   // SHA3-256(0x01 || left || right)
+    byte in[65];
+    in[0] = kNodePrefix;
+    std::memcpy(in + 1, left.data(), left.size());
+    std::memcpy(in + 1 + left.size(), right.data(), right.size());
+    return (OneBlockSHA3_256::digest<65>(in));
+} // end hash_node(...)
+
+//-----------------------------------------------------------------
+inline void MerkleTree::build(const std::vector<std::string>& leaves)
+{   // Hash the leaves (in parallel, by the multi-message kernel) and
+    // build the tree. The kernel reads whole messages, so the leaves are
+    // copied after the prefix byte, kLeafBatch at a time.
+    std::vector<Digest256> digests(leaves.size());
+    run_parallel(leaves.size(), [&](size_t from, size_t to) {
+        std::vector<std::string> bufs(kLeafBatch);
+        const char* msgs[kLeafBatch];
+        size_t lens[kLeafBatch];
+        byte* outs[kLeafBatch];
+        for (size_t first = from; first < to; first += kLeafBatch) {
+            size_t n = std::min(kLeafBatch, to - first);
+            for (size_t k = 0; k < n; k++) {
+                bufs[k].assign(1, static_cast<char>(kLeafPrefix));
+                bufs[k] += leaves[first + k];
+                msgs[k] = bufs[k].data();
+                lens[k] = bufs[k].size();
+                outs[k] = digests[first + k].data();
+            }
+            hash_many(kSHA3_256, msgs, lens, outs, n);
+        }
+    });
+    build(std::move(digests));
+} // end build(...)
+
+//-------------------------------------------------------------
+inline void MerkleTree::build(std::vector<Digest256> leaf_digests)
+{
+    levels_.clear();
+    if (leaf_digests.empty())
+        return;
+    levels_.push_back(std::move(leaf_digests));
+    build_levels();
+} // end build(...)
+
+//-------------------------------------
+inline void MerkleTree::build_levels()
+{   // Each level is split between worker threads
+    while (levels_.back().size() > 1) {
+        const std::vector<Digest256>& src = levels_.back();
+        std::vector<Digest256> dst((src.size() + 1) / 2);
+        run_parallel(dst.size(), [&](size_t from, size_t to) {
+            hash_level(src, dst, from, to);
+        });
+        levels_.push_back(std::move(dst));
+    }
+} // end build_levels()
+
+//-----------------------------------------------------------------------------
+inline void MerkleTree::hash_level(const std::vector<Digest256>& src,
+                                   std::vector<Digest256>& dst,
+                                   size_t from, size_t to) const
+{   // Hash parents [from, to) of level <src>, kBatch nodes per permutation
+    const size_t pairs = std::min<size_t>(to, src.size() / 2);  // parents with 2 kids
+    size_t i = from;
+    for (; i + kBatch <= pairs; i += kBatch) {
+        const byte* in[kBatch];
+        byte* out[kBatch];
+        for (size_t k = 0; k < kBatch; k++) {
+            // src[2p] and src[2p+1] are adjacent: 64 contiguous bytes
+            in[k] = src[2 * (i + k)].data();
+            out[k] = dst[i + k].data();
+        }
+        sha3_256_node_mb<kBatch>(kNodePrefix, in, out);
+    }
+    for (; i < pairs; i++)
+        dst[i] = hash_node(src[2 * i], src[2 * i + 1]);
+    for (; i < to; i++)                 // the lonely node is promoted
+        dst[i] = src[2 * i];
+} // end hash_level(...)
+
+//-----------------------------------------------------------------------------
+template<typename Func>
+inline void MerkleTree::run_parallel(size_t count, Func func) const
+{   // Split [0, count) into contiguous ranges, one per worker thread
+    size_t workers = std::min<size_t>(threads_, count / kMinPerThread);
+    if (workers < 2) {
+        func(0, count);
+        return;
+    }
+    std::vector<std::thread> pool;
+    size_t chunk = (count + workers - 1) / workers;
+    for (size_t from = chunk; from < count; from += chunk)
+        pool.emplace_back(func, from, std::min(from + chunk, count));
+    func(0, chunk);
+    for (auto& thr : pool)
+        thr.join();
+} // end run_parallel(...)
+
+//---------------------------------------------------------------------------
+inline void MerkleTree::update(size_t index, const char* data, const size_t size)
+{
+    update(index, hash_leaf(data, size));
+} // end update(...)
+
+//-------------------------------------------------------------------
+inline void MerkleTree::update(size_t index, const std::string& data)
+{   // Wrapper function
+    update(index, hash_leaf(data.data(), data.size()));
+}
+
+//---------------------------------------------------------------------------
+inline void MerkleTree::update(size_t index, const Digest256& leaf_digest)
+{   // Replace a leaf and rehash only the path from it to the root
+    if (index >= leaf_count())
+        throw std::out_of_range("MerkleTree: leaf index out of range");
+    levels_[0][index] = leaf_digest;
+    for (size_t lvl = 1; lvl < levels_.size(); lvl++) {
+        const std::vector<Digest256>& src = levels_[lvl - 1];
+        index /= 2;
+        if (2 * index + 1 < src.size())
+            levels_[lvl][index] = hash_node(src[2 * index], src[2 * index + 1]);
+        else
+            levels_[lvl][index] = src[2 * index];
+    }
+} // end update(...)
+
+//----------------------------------------
+inline Digest256 MerkleTree::root() const
+{   // The root of an empty tree is SHA3-256("") (no leaf prefix)
+    if (levels_.empty()) {
+        Digest256 empty;
+        OneBlockSHA3_256::hash(nullptr, 0, empty.data());
+        return (empty);
+    }
+    return (levels_.back().front());
+} // end root()
+
+//---------------------------------------------------------------
+inline MerkleProof MerkleTree::get_proof(size_t index) const
+{   // Collect sibling hashes on the path from leaf <index> to the root
+    if (index >= leaf_count())
+        throw std::out_of_range("MerkleTree: leaf index out of range");
+    MerkleProof proof;
+    proof.index = index;
+    proof.leaf_count = leaf_count();
+    for (size_t lvl = 0; lvl + 1 < levels_.size(); lvl++, index /= 2) {
+        size_t sibling = index ^ 1;
+        if (sibling < levels_[lvl].size())
+            proof.path.push_back(levels_[lvl][sibling]);
+    }
+    return (proof);
+} // end get_proof(...)
+
+//-----------------------------------------------------------------------------
+inline bool MerkleTree::verify(const Digest256& root,
+                               const Digest256& leaf_digest,
+                               const MerkleProof& proof) noexcept
+{   // Recompute the root from the leaf and its proof
+    if (proof.index >= proof.leaf_count)
+        return (false);
+    Digest256 node = leaf_digest;
+    size_t index = proof.index;
+    size_t used = 0;
+    for (size_t width = proof.leaf_count; width > 1; width = (width + 1) / 2) {
+        if ((index ^ 1) < width) {          // the sibling exists
+            if (used == proof.path.size())
+                return (false);
+            const Digest256& sibling = proof.path[used++];
+            node = (index & 1) ? hash_node(sibling, node)
+                               : hash_node(node, sibling);
+        }
+        index /= 2;
+    }
+    return (used == proof.path.size() and node == root);
+} // end verify(...)
+
+//====== end for class MerkleTree definition ======
+
+} // end namespace "chash"
+
+//-----------------------------------------------------------------------------
+#endif /* SHA3_MERKLE_H_ */
@@ -0,0 +1,271 @@
+/******************************************************************************
+
+Copyright (c) 2022 Elijah Coleman
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef SHA3_POOL_H_
+#define SHA3_POOL_H_
+
+//-----------------------------------------------------------------------------
+// Pool of pre-initialized hasher objects for concurrent hashing services.
+// Objects of IUFKeccak are non-copyable and non-movable, so instead of
+// constructing a new object per request the object is leased from a pool
+// and returned (re-initialized) when the lease goes out of scope.
+//   * The pool is a lock-free stack of cache line aligned slots.
+//   * Pools returned by hasher_pool() additionally keep one slot per thread
+//     in a thread-local cache (no atomic operations at all).
+// Requires C++17 (aligned new) and linking with the threads library.
+
+#include "sha3_ec.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <map>
+#include <thread>
+#include <cstdint>
+
+namespace chash     // "cryptographic hash"
+{
+static const size_t kCacheLine = 64;
+
+//====== Lock-free pool of IUFKeccak objects ======
+class HasherPool
+{
+    struct alignas(kCacheLine) Slot {   // one hasher per cache line(s)
+        IUFKeccak hasher;
+        std::atomic<std::uint32_t> next;
+    };
+public:
+    //------ RAII lease of a pooled hasher ------
+    class Lease
+    {
+    public:
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        Lease(Lease&& other) noexcept
+        :   pool_(other.pool_), hasher_(other.hasher_), index_(other.index_)
+        {  other.hasher_ = nullptr;  }
+        Lease& operator=(Lease&& other) noexcept
+        {
+            if (this != &other) {
+                release();
+                pool_ = other.pool_;
+                hasher_ = other.hasher_;
+                index_ = other.index_;
+                other.hasher_ = nullptr;
+            }
+            return (*this);
+        }
+        ~Lease() {  release();  }
+
+        IUFKeccak& operator*() const noexcept   {  return (*hasher_);  }
+        IUFKeccak* operator->() const noexcept  {  return (hasher_);  }
+        IUFKeccak* get() const noexcept         {  return (hasher_);  }
+
+    private:
+        friend class HasherPool;
+        Lease(HasherPool* pool, IUFKeccak* hasher, std::uint32_t index)
+        :   pool_(pool), hasher_(hasher), index_(index)
+        {}
+        void release() noexcept
+        {
+            if (hasher_)
+                pool_->release(hasher_, index_);
+            hasher_ = nullptr;
+        }
+
+        HasherPool*   pool_;
+        IUFKeccak*    hasher_;
+        std::uint32_t index_;       // kNone - object is not from the pool
+    }; // end for class Lease
+
+    HasherPool(const HasherPool&) = delete;
+    HasherPool& operator=(const HasherPool&) = delete;
+
+    explicit HasherPool(const KeccParam& param, size_t capacity = 0);
+    ~HasherPool() {}
+
+    //------ Main Interface ------
+    Lease acquire();
+    const KeccParam& param() const noexcept  {  return (param_);  }
+    size_t capacity() const noexcept         {  return (capacity_);  }
+    size_t overflow_count() const noexcept
+    {  return (overflow_.load(std::memory_order_relaxed));  }
+
+private:
+    friend HasherPool& hasher_pool(const KeccParam& param);
+    static const std::uint32_t kNone = 0xFFFFFFFF;
+    static const int kCachedPools = 6;      // standard SHA3/SHAKE parameters
+
+    struct ThreadCache {    // per-thread slot of every standard pool
+        HasherPool*   pool[kCachedPools] = {};
+        std::uint32_t index[kCachedPools] = {kNone, kNone, kNone,
+                                             kNone, kNone, kNone};
+        ~ThreadCache()
+        {   // return cached slots when the thread exits
+            for (int i = 0; i < kCachedPools; i++)
+                if (pool[i] and kNone != index[i])
+                    pool[i]->push(index[i]);
+        }
+    };
+    static ThreadCache& thread_cache()
+    {
+        thread_local ThreadCache cache;
+        return (cache);
+    }
+
+    static HasherPool* new_cached(const KeccParam& param, int cache_id)
+    {   // pool with the thread-local fast path
+        HasherPool* pool = new HasherPool(param);
+        pool->cache_id_ = cache_id;
+        return (pool);
+    }
+    std::uint32_t pop() noexcept;
+    void push(std::uint32_t index) noexcept;
+    void release(IUFKeccak* hasher, std::uint32_t index) noexcept;
+
+    //------ Class Data Members ------
+    KeccParam param_;
+    size_t capacity_;
+    int cache_id_;              // index in ThreadCache, -1 - not cached
+    std::unique_ptr<Slot[]> slots_;
+    alignas(kCacheLine) std::atomic<std::uint64_t> head_;  // (tag << 32) | top
+    alignas(kCacheLine) std::atomic<size_t> overflow_;
+}; // end for class HasherPool declaration
+
+//-----------------------------------------------------------------------------
+inline HasherPool::HasherPool(const KeccParam& param, size_t capacity)
+:   param_(param), capacity_(capacity), cache_id_(-1), head_(0), overflow_(0)
+{
+    if (!capacity_)
+        capacity_ = std::max<size_t>(64, 4 * std::thread::hardware_concurrency());
+    slots_.reset(new Slot[capacity_]);
+    for (size_t i = 0; i < capacity_; i++) {
+        slots_[i].hasher.setup(param_);
+        slots_[i].hasher.init();
+        slots_[i].next.store(static_cast<std::uint32_t>(i + 1) < capacity_ ?
+            static_cast<std::uint32_t>(i + 1) : kNone, std::memory_order_relaxed);
+    }
+    head_.store(0, std::memory_order_release);      // tag 0, top - slot 0
+} // end HasherPool::HasherPool(...)
+
+//-------------------------------------------
+inline HasherPool::Lease HasherPool::acquire()
+{   // Thread-local slot first, then the shared stack, then the heap
+    if (cache_id_ >= 0) {
+        ThreadCache& cache = thread_cache();
+        std::uint32_t index = cache.index[cache_id_];
+        if (kNone != index) {
+            cache.index[cache_id_] = kNone;
+            return (Lease(this, &slots_[index].hasher, index));
+        }
+    }
+    std::uint32_t index = pop();
+    if (kNone != index)
+        return (Lease(this, &slots_[index].hasher, index));
+    overflow_.fetch_add(1, std::memory_order_relaxed);
+    return (Lease(this, new IUFKeccak(param_), kNone));
+} // end acquire()
+
+//-----------------------------------------------------------------------------
+inline void HasherPool::release(IUFKeccak* hasher, std::uint32_t index) noexcept
+{   // Re-initialize the hasher (a digest size or separator might be changed)
+    if (kNone == index) {
+        delete hasher;
+        return;
+    }
+    hasher->setup(param_);
+    hasher->set_separator(0);
+    hasher->init();
+    if (cache_id_ >= 0) {
+        ThreadCache& cache = thread_cache();
+        if (kNone == cache.index[cache_id_]) {
+            cache.pool[cache_id_] = this;
+            cache.index[cache_id_] = index;
+            return;
+        }
+    }
+    push(index);
+} // end release(...)
+
+//--------------------------------------------
+inline std::uint32_t HasherPool::pop() noexcept
+{   // The tag is incremented on every change of the top (ABA protection)
+    std::uint64_t head = head_.load(std::memory_order_acquire);
+    for (;;) {
+        std::uint32_t top = static_cast<std::uint32_t>(head);
+        if (kNone == top)
+            return (kNone);
+        std::uint32_t next = slots_[top].next.load(std::memory_order_relaxed);
+        std::uint64_t tag = (head >> 32) + 1;
+        if (head_.compare_exchange_weak(head, (tag << 32) | next,
+                std::memory_order_acquire, std::memory_order_acquire))
+            return (top);
+    }
+} // end pop()
+
+//--------------------------------------------------
+inline void HasherPool::push(std::uint32_t index) noexcept
+{
+    std::uint64_t head = head_.load(std::memory_order_relaxed);
+    for (;;) {
+        slots_[index].next.store(static_cast<std::uint32_t>(head),
+                                 std::memory_order_relaxed);
+        std::uint64_t tag = (head >> 32) + 1;
+        if (head_.compare_exchange_weak(head, (tag << 32) | index,
+                std::memory_order_release, std::memory_order_relaxed))
+            return;
+    }
+} // end push(...)
+
+//====== end for class HasherPool definition ======
+
+//-----------------------------------------------------------------------------
+inline HasherPool& hasher_pool(const KeccParam& param)
+{   // Process-wide pools keyed by KeccParam. The pools are never destroyed,
+    // so slots held by thread-local caches always can be returned.
+    static HasherPool* standard[HasherPool::kCachedPools] = {
+        HasherPool::new_cached(kSHA3_224, 0), HasherPool::new_cached(kSHA3_256, 1),
+        HasherPool::new_cached(kSHA3_384, 2), HasherPool::new_cached(kSHA3_512, 3),
+        HasherPool::new_cached(kSHAKE128, 4), HasherPool::new_cached(kSHAKE256, 5)
+    };
+    for (int i = 0; i < HasherPool::kCachedPools; i++) {
+        const KeccParam& std_param = standard[i]->param();
+        if (std_param.hash_size == param.hash_size and std_param.dom == param.dom)
+            return (*standard[i]);
+    }
+    // Non-standard parameters (rare): created on demand under the lock
+    static std::mutex guard;
+    static std::map<std::pair<HashSize, Domain>, HasherPool*> others;
+    std::lock_guard<std::mutex> lock(guard);
+    HasherPool*& pool = others[{param.hash_size, param.dom}];
+    if (!pool)
+        pool = new HasherPool(param);
+    return (*pool);
+} // end hasher_pool(...)
+
+} // end namespace "chash"
+
+//-----------------------------------------------------------------------------
+#endif /* SHA3_POOL_H_ */
@@ -0,0 +1,260 @@
+/******************************************************************************
+
+Copyright (c) 2022 Elijah Coleman
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef SHA3_STREAM_H_
+#define SHA3_STREAM_H_
+
+//-----------------------------------------------------------------------------
+// Hashing stream buffers: std::streambuf adapters that forward to an
+// underlying streambuf and absorb the very same buffer into an IUFKeccak
+// as the data flows through (no extra copy, no second pass).
+//   HashIStreambuf - reading side: hashes the bytes consumed by the reader;
+//   HashOStreambuf - writing side: hashes the bytes written to the sink.
+// The internal buffer is a multiple of the rate, so whole buffers go through
+// the fused kernel of update_fast. Seeking is not supported.
+
+#include "sha3_ec.h"
+
+#include <streambuf>
+#include <memory>
+
+namespace chash     // "cryptographic hash"
+{
+//====== Input hashing stream buffer ======
+class HashIStreambuf : public std::streambuf
+{
+public:
+    HashIStreambuf(const HashIStreambuf&) = delete;
+    HashIStreambuf& operator=(const HashIStreambuf&) = delete;
+
+    // <buf> - optional external buffer of <buf_size> bytes (otherwise
+    // kBlocks rate blocks are allocated)
+    HashIStreambuf(std::streambuf* src, IUFKeccak& hasher,
+                   char* buf = nullptr, size_t buf_size = 0);
+
+    std::streamsize consume_all();      // pump <src> to EOF (hash only)
+    std::vector<byte> finalize();       // absorb consumed bytes, get digest
+    size_t hashed() const noexcept  {  return (hashed_total_);  }
+
+    static constexpr size_t kBlocks = 64;   // default buffer size (in blocks)
+
+protected:
+    int_type underflow() override;
+    std::streamsize showmanyc() override;
+
+private:
+    void absorb_consumed();
+
+    //------ Class Data Members ------
+    std::streambuf* src_;
+    IUFKeccak& hasher_;
+    std::unique_ptr<char[]> own_;
+    char* buf_;
+    size_t buf_size_;
+    char* hashed_;                      // consumed bytes before it are hashed
+    size_t hashed_total_;
+};  // end for class HashIStreambuf declaration
+
+//-----------------------------------------------------------------------------
+inline HashIStreambuf::HashIStreambuf(std::streambuf* src, IUFKeccak& hasher,
+                                      char* buf, size_t buf_size)
+    :   src_(src), hasher_(hasher), buf_(buf), buf_size_(buf_size),
+        hashed_(nullptr), hashed_total_(0)
+{
+    const size_t rate8 = hasher_.get_rate() / k8Bits;
+    if (nullptr == buf_ or buf_size_ < rate8) {
+        buf_size_ = kBlocks * rate8;
+        own_ = std::make_unique<char[]>(buf_size_);
+        buf_ = own_.get();
+    }
+    buf_size_ -= buf_size_ % rate8;     // rate-aligned chunks
+    setg(buf_, buf_, buf_);
+    hashed_ = buf_;
+} // end HashIStreambuf(...)
+
+//-----------------------------------------------
+inline void HashIStreambuf::absorb_consumed()
+{   // Hash the bytes handed out to the reader since the last call
+    if (gptr() > hashed_) {
+        hasher_.update_fast(hashed_, gptr() - hashed_);
+        hashed_total_ += gptr() - hashed_;
+        hashed_ = gptr();
+    }
+} // end absorb_consumed()
+
+//-------------------------------------------------------
+inline HashIStreambuf::int_type HashIStreambuf::underflow()
+{   // The whole get area was consumed: hash it and refill the buffer
+    absorb_consumed();
+    std::streamsize n = src_->sgetn(buf_, buf_size_);
+    if (n <= 0) {
+        setg(buf_, buf_, buf_);
+        hashed_ = buf_;
+        return (traits_type::eof());
+    }
+    setg(buf_, buf_, buf_ + n);
+    hashed_ = buf_;
+    return (traits_type::to_int_type(*gptr()));
+} // end underflow()
+
+//---------------------------------------------
+inline std::streamsize HashIStreambuf::showmanyc()
+{
+    return (src_->in_avail());
+} // end showmanyc()
+
+//------------------------------------------------
+inline std::streamsize HashIStreambuf::consume_all()
+{   // Hash the rest of <src> without copying it to a reader
+    std::streamsize total = 0;
+    while (gptr() != egptr() or
+           !traits_type::eq_int_type(underflow(), traits_type::eof())) {
+        total += egptr() - gptr();
+        setg(eback(), egptr(), egptr());
+    }
+    absorb_consumed();
+    return (total);
+} // end consume_all()
+
+//----------------------------------------------------
+inline std::vector<byte> HashIStreambuf::finalize()
+{
+    absorb_consumed();
+    return (hasher_.finalize());
+} // end finalize()
+
+//====== end for class HashIStreambuf definition ======
+
+
+//====== Output hashing stream buffer ======
+class HashOStreambuf : public std::streambuf
+{
+public:
+    HashOStreambuf(const HashOStreambuf&) = delete;
+    HashOStreambuf& operator=(const HashOStreambuf&) = delete;
+
+    // <dst> may be nullptr: the data is only hashed
+    HashOStreambuf(std::streambuf* dst, IUFKeccak& hasher,
+                   char* buf = nullptr, size_t buf_size = 0);
+    ~HashOStreambuf() override  {  flush_buffer();  }
+
+    std::vector<byte> finalize();       // flush, get digest
+    size_t hashed() const noexcept  {  return (hashed_total_);  }
+
+    static constexpr size_t kBlocks = 64;   // default buffer size (in blocks)
+
+protected:
+    int_type overflow(int_type ch) override;
+    std::streamsize xsputn(const char* s, std::streamsize n) override;
+    int sync() override;
+
+private:
+    bool flush_buffer();
+    bool forward(const char* s, std::streamsize n);
+
+    //------ Class Data Members ------
+    std::streambuf* dst_;
+    IUFKeccak& hasher_;
+    std::unique_ptr<char[]> own_;
+    char* buf_;
+    size_t buf_size_;
+    size_t hashed_total_;
+};  // end for class HashOStreambuf declaration
+
+//-----------------------------------------------------------------------------
+inline HashOStreambuf::HashOStreambuf(std::streambuf* dst, IUFKeccak& hasher,
+                                      char* buf, size_t buf_size)
+    :   dst_(dst), hasher_(hasher), buf_(buf), buf_size_(buf_size),
+        hashed_total_(0)
+{
+    const size_t rate8 = hasher_.get_rate() / k8Bits;
+    if (nullptr == buf_ or buf_size_ < rate8) {
+        buf_size_ = kBlocks * rate8;
+        own_ = std::make_unique<char[]>(buf_size_);
+        buf_ = own_.get();
+    }
+    buf_size_ -= buf_size_ % rate8;     // rate-aligned chunks
+    setp(buf_, buf_ + buf_size_);
+} // end HashOStreambuf(...)
+
+//-------------------------------------------------------------------
+inline bool HashOStreambuf::forward(const char* s, std::streamsize n)
+{   // Hash <s> and pass it on to the sink
+    hasher_.update_fast(s, n);
+    hashed_total_ += n;
+    return (nullptr == dst_ or dst_->sputn(s, n) == n);
+} // end forward(...)
+
+//-----------------------------------------
+inline bool HashOStreambuf::flush_buffer()
+{
+    std::streamsize n = pptr() - pbase();
+    setp(buf_, buf_ + buf_size_);
+    return (n == 0 or forward(buf_, n));
+} // end flush_buffer()
+
+//-------------------------------------------------------------------
+inline HashOStreambuf::int_type HashOStreambuf::overflow(int_type ch)
+{
+    if (!flush_buffer())
+        return (traits_type::eof());
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+    }
+    return (traits_type::not_eof(ch));
+} // end overflow(...)
+
+//---------------------------------------------------------------------------
+inline std::streamsize HashOStreambuf::xsputn(const char* s, std::streamsize n)
+{   // Large writes bypass the buffer: hashed and forwarded in place
+    if (n < epptr() - pptr())
+        return (std::streambuf::xsputn(s, n));
+    if (!flush_buffer())
+        return (0);
+    return (forward(s, n) ? n : 0);
+} // end xsputn(...)
+
+//-------------------------------
+inline int HashOStreambuf::sync()
+{
+    if (!flush_buffer())
+        return (-1);
+    return ((nullptr == dst_) ? 0 : dst_->pubsync());
+} // end sync()
+
+//----------------------------------------------------
+inline std::vector<byte> HashOStreambuf::finalize()
+{
+    sync();
+    return (hasher_.finalize());
+} // end finalize()
+
+//====== end for class HashOStreambuf definition ======
+
+} // end namespace "chash"
+
+//-----------------------------------------------------------------------------
+#endif /* SHA3_STREAM_H_ */
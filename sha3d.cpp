@@ -0,0 +1,388 @@
+/******************************************************************************
+
+Copyright (c) 2022 Elijah Coleman
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+******************************************************************************/
+//=============================================================================
+// sha3d - local hashing daemon (POSIX, Unix domain socket).
+// Small requests of all connections are coalesced into batches hashed by
+// the multi-buffer kernels (hash_many); large requests are streamed into a
+// SHA3_IUF on the connection thread without buffering the whole message.
+// Protocol and client: sha3d_client.h.
+
+#include "sha3_ec.h"
+#include "sha3_mb.h"
+#include "sha3d_client.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+//=============================================================================
+enum ErrCode { kOk = 0, kError};
+
+static int print_summary(int exit_code)
+{
+    std::cout << "Usage: sha3d [OPTIONS]..."
+        << "\nLocal SHA3/SHAKE hashing daemon (Unix domain socket)."
+        << "\n[OPTIONS]"
+        << "\n  --help          Display this summary"
+        << "\n  -socket path    Socket path (default: " << sha3d::kDefaultSocket << ")"
+        << "\n  -small bytes    Requests up to this size are batched (default: 4096)"
+        << "\n  -wait us        Max wait for a batch to fill (default: 50 us)"
+        << "\nEXIT STATUS :"
+        << "\n  0               Successful completion"
+        << "\n  1               An error occures"
+        << std::endl;
+    return (exit_code);
+} // end print_summary()
+
+//-----------------------------------------------------------------------------
+static bool parse_number(const char* text, unsigned long& value)
+{   // The whole argument must be a decimal number that fits <value>
+    if (!std::isdigit(static_cast<unsigned char>(text[0])))
+        return (false);
+    char* end = nullptr;
+    errno = 0;
+    value = std::strtoul(text, &end, 10);
+    return (0 == errno and '\0' == *end);
+} // end parse_number(...)
+
+//=============================================================================
+class Sha3Daemon
+{
+    using clock = std::chrono::steady_clock;
+    struct Pending {                    // a small request waiting for a batch
+        uint8_t algo;
+        uint32_t digest_bits;
+        std::vector<char> data;
+        std::vector<chash::byte> digest;
+        std::promise<void> done;
+    };
+public:
+    Sha3Daemon(size_t small_limit, unsigned wait_us)
+    :   small_limit_(small_limit), wait_us_(wait_us), stop_(false),
+        requests_(0), batched_(0), streamed_(0), batches_(0), max_depth_(0),
+        latency_pos_(0)
+    {}
+
+    int run(const std::string& path);
+
+private:
+    void serve(int fd);
+    void batcher();
+    bool hash_streamed(int fd, const sha3d::RequestHeader& hdr,
+                       std::vector<chash::byte>& digest);
+    void record_latency(clock::time_point start);
+    std::string stats();
+
+    static constexpr size_t kMaxBatch = 64;
+    static constexpr size_t kLatencySamples = 4096;
+
+    const size_t small_limit_;
+    const unsigned wait_us_;
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    std::deque<Pending*> queue_;
+    bool stop_;
+    std::set<int> conns_;               // sockets of the connection threads
+    std::condition_variable conn_cv_;   // notified when one of them ends
+    std::atomic<uint64_t> requests_, batched_, streamed_, batches_;
+    std::atomic<size_t> max_depth_;
+    std::mutex lat_mtx_;
+    std::vector<double> latency_;       // ring of the last samples (us)
+    size_t latency_pos_;
+};  // end class Sha3Daemon declaration
+
+//=============================================================================
+//************************* MAIN **********************************************
+//=============================================================================
+int main(int argc, const char* argv[])
+{
+    std::string path = sha3d::kDefaultSocket;
+    unsigned long small_limit = 4096;
+    unsigned long wait_us = 50;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--help") == 0)
+            return (print_summary(kOk));
+        if (i + 1 == argc)
+            return (print_summary(kError));
+        if (std::strcmp(argv[i], "-socket") == 0)
+            path = argv[++i];
+        else if (std::strcmp(argv[i], "-small") == 0) {
+            if (!parse_number(argv[++i], small_limit))
+                return (print_summary(kError));
+        }
+        else if (std::strcmp(argv[i], "-wait") == 0) {
+            if (!parse_number(argv[++i], wait_us) or wait_us > UINT_MAX)
+                return (print_summary(kError));
+        }
+        else
+            return (print_summary(kError));
+    }
+    std::signal(SIGPIPE, SIG_IGN);
+    Sha3Daemon daemon(small_limit, static_cast<unsigned>(wait_us));
+    return (daemon.run(path));
+} // end main(...)
+//=============================================================================
+//*****************************************************************************
+//=============================================================================
+
+//------ Class Sha3Daemon ------
+int Sha3Daemon::run(const std::string& path)
+{
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Socket path is too long!" << std::endl;
+        return (kError);
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    int lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    unlink(path.c_str());
+    if (lfd < 0 or bind(lfd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr))
+            or listen(lfd, 128)) {
+        std::cerr << "(" << path << ") - Error creating socket: "
+                  << std::strerror(errno) << std::endl;
+        return (kError);
+    }
+    std::thread batcher(&Sha3Daemon::batcher, this);
+    for (;;) {
+        int fd = accept(lfd, nullptr, nullptr);
+        if (fd < 0) {
+            if (EINTR == errno)
+                continue;
+            break;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            conns_.insert(fd);
+        }
+        std::thread(&Sha3Daemon::serve, this, fd).detach();
+    }
+    std::cerr << "(" << path << ") - Error accepting connections: "
+              << std::strerror(errno) << std::endl;
+    {   // new requests are refused, blocked reads of the connections fail
+        std::lock_guard<std::mutex> lock(mtx_);
+        stop_ = true;
+        for (int fd : conns_)
+            shutdown(fd, SHUT_RDWR);
+    }
+    cv_.notify_one();
+    batcher.join();                     // after the queued requests
+    {   // the connection threads use the members until they end
+        std::unique_lock<std::mutex> lock(mtx_);
+        conn_cv_.wait(lock, [this] {  return (conns_.empty());  });
+    }
+    close(lfd);
+    return (kError);
+} // end Sha3Daemon::run(...)
+
+//-----------------------------------------------------------------------------
+void Sha3Daemon::serve(int fd)
+{   // Connection thread: requests are answered in order
+    sha3d::RequestHeader hdr;
+    std::vector<chash::byte> reply;
+    while (sha3d::read_full(fd, &hdr, sizeof(hdr))) {
+        clock::time_point start = clock::now();
+        sha3d::ResponseHeader resp{};
+        reply.clear();
+        if (sha3d::kOpStats == hdr.op) {
+            std::string text = stats();
+            reply.assign(text.begin(), text.end());
+        }
+        else if (sha3d::kOpHash != hdr.op or hdr.algo >= sha3d::kAlgoCount
+                 or hdr.digest_bits > sha3d::kMaxDigestBits) {
+            resp.status = sha3d::kStatusBadRequest;
+            sha3d::write_full(fd, &resp, sizeof(resp));
+            break;                      // the stream can not be resynchronized
+        }
+        else if (hdr.length <= small_limit_) {
+            Pending req;                // coalesced with other requests
+            req.algo = hdr.algo;
+            req.digest_bits = hdr.digest_bits;
+            req.data.resize(hdr.length);
+            if (!sha3d::read_full(fd, req.data.data(), req.data.size()))
+                break;
+            std::future<void> done = req.done.get_future();
+            bool refused;
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                refused = stop_;
+                if (!refused) {
+                    queue_.push_back(&req);
+                    max_depth_ = std::max<size_t>(max_depth_, queue_.size());
+                }
+            }
+            if (refused) {              // shutting down: no batcher to wait for
+                resp.status = sha3d::kStatusBadRequest;
+                sha3d::write_full(fd, &resp, sizeof(resp));
+                break;
+            }
+            cv_.notify_one();
+            done.wait();
+            reply.swap(req.digest);
+            batched_++;
+        }
+        else {
+            if (!hash_streamed(fd, hdr, reply))
+                break;
+            streamed_++;
+        }
+        resp.length = static_cast<uint32_t>(reply.size());
+        if (!sha3d::write_full(fd, &resp, sizeof(resp))
+                or !sha3d::write_full(fd, reply.data(), reply.size()))
+            break;
+        requests_++;
+        record_latency(start);
+    }
+    std::lock_guard<std::mutex> lock(mtx_);
+    conns_.erase(fd);
+    close(fd);                          // under the lock: not shut down by run()
+    conn_cv_.notify_all();
+} // end Sha3Daemon::serve(...)
+
+//-----------------------------------------------------------------------------
+bool Sha3Daemon::hash_streamed(int fd, const sha3d::RequestHeader& hdr,
+                               std::vector<chash::byte>& digest)
+{   // Large request: absorbed chunk by chunk as it arrives
+    chash::SHA3_IUF obj(sha3d::algo_param(hdr.algo));
+    if (hdr.digest_bits)
+        obj.set_digest_size(hdr.digest_bits);
+    const size_t chunk = (obj.get_rate() / 8) * 512;
+    std::vector<char> buf(chunk);
+    for (uint64_t left = hdr.length; left; ) {
+        size_t n = static_cast<size_t>(std::min<uint64_t>(left, chunk));
+        if (!sha3d::read_full(fd, buf.data(), n))
+            return (false);
+        obj.update_fast(buf.data(), n);
+        left -= n;
+    }
+    digest = obj.finalize();
+    return (true);
+} // end Sha3Daemon::hash_streamed(...)
+
+//-----------------------------------------------------------------------------
+void Sha3Daemon::batcher()
+{   // Collects the small requests of all connections (up to kMaxBatch, or
+    // whatever arrived within <wait_us_> after the first one) and hashes each
+    // group of the same algorithm with the multi-buffer kernels
+    std::vector<Pending*> batch;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            cv_.wait(lock, [this] {  return (stop_ or !queue_.empty());  });
+            if (queue_.empty())
+                return;                 // stopped
+            cv_.wait_for(lock, std::chrono::microseconds(wait_us_),
+                         [this] {  return (stop_ or queue_.size() >= kMaxBatch);  });
+            size_t n = std::min(queue_.size(), kMaxBatch);
+            batch.assign(queue_.begin(), queue_.begin() + n);
+            queue_.erase(queue_.begin(), queue_.begin() + n);
+        }
+        std::stable_sort(batch.begin(), batch.end(), [](Pending* a, Pending* b) {
+            return (a->algo != b->algo ? a->algo < b->algo
+                                       : a->digest_bits < b->digest_bits);
+        });
+        for (size_t from = 0, to = 0; from < batch.size(); from = to) {
+            while (to < batch.size() and batch[to]->algo == batch[from]->algo
+                   and batch[to]->digest_bits == batch[from]->digest_bits)
+                to++;
+            chash::KeccParam param = sha3d::algo_param(batch[from]->algo);
+            chash::size_t bits = batch[from]->digest_bits;
+            if (!bits or chash::Domain::kDomSHA3 == param.dom)
+                bits = static_cast<chash::size_t>(param.hash_size);
+            std::vector<const char*> msgs;
+            std::vector<chash::size_t> lens;
+            std::vector<chash::byte*> outs;
+            for (size_t i = from; i < to; i++) {
+                batch[i]->digest.resize((bits + 7) / 8);
+                msgs.push_back(batch[i]->data.data());
+                lens.push_back(batch[i]->data.size());
+                outs.push_back(batch[i]->digest.data());
+            }
+            chash::hash_many(param, msgs.data(), lens.data(), outs.data(),
+                             to - from, bits);
+        }
+        batches_++;
+        for (Pending* req : batch)
+            req->done.set_value();
+    }
+} // end Sha3Daemon::batcher()
+
+//-----------------------------------------------------------------------------
+void Sha3Daemon::record_latency(clock::time_point start)
+{
+    double us = std::chrono::duration<double, std::micro>(clock::now() - start).count();
+    std::lock_guard<std::mutex> lock(lat_mtx_);
+    if (latency_.size() < kLatencySamples)
+        latency_.push_back(us);
+    else
+        latency_[latency_pos_++ % kLatencySamples] = us;
+} // end Sha3Daemon::record_latency(...)
+
+//-----------------------------------------------------------------------------
+std::string Sha3Daemon::stats()
+{   // "name value" lines; latency percentiles over the last kLatencySamples
+    std::vector<double> lat;
+    {
+        std::lock_guard<std::mutex> lock(lat_mtx_);
+        lat = latency_;
+    }
+    std::sort(lat.begin(), lat.end());
+    auto pct = [&lat](double p) {
+        return (lat.empty() ? 0.0 : lat[static_cast<size_t>(p * (lat.size() - 1))]);
+    };
+    size_t depth;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        depth = queue_.size();
+    }
+    std::ostringstream out;
+    out << "requests " << requests_ << "\nbatched " << batched_
+        << "\nstreamed " << streamed_ << "\nbatches " << batches_
+        << "\nqueue_depth " << depth << "\nmax_queue_depth " << max_depth_
+        << "\nlatency_p50_us " << pct(0.50) << "\nlatency_p90_us " << pct(0.90)
+        << "\nlatency_p99_us " << pct(0.99) << "\n";
+    return (out.str());
+} // end Sha3Daemon::stats()
@@ -0,0 +1,202 @@
+/******************************************************************************
+
+Copyright (c) 2022 Elijah Coleman
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef SHA3D_CLIENT_H_
+#define SHA3D_CLIENT_H_
+
+//-----------------------------------------------------------------------------
+// Protocol of the sha3d hashing daemon and its client (POSIX, Unix domain
+// stream socket). Both ends run on the same host, so the headers are sent
+// as raw structs: the integers are in the host byte order.
+//   request:  u8 op | u8 algo | u16 reserved | u32 digest_bits | u64 length
+//             followed by <length> bytes of the message (op == kOpHash)
+//   response: u8 status | u8[3] reserved | u32 length
+//             followed by <length> bytes (the digest or the statistics text)
+// A connection carries any number of requests, answered in order.
+
+#include "sha3_ec.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL                // no SIGPIPE on a closed peer (Linux)
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace sha3d
+{
+//------ Protocol constants ------
+enum Op : uint8_t { kOpHash = 1, kOpStats = 2 };
+enum Algo : uint8_t { kSHA3_224 = 0, kSHA3_256, kSHA3_384, kSHA3_512,
+                      kSHAKE128, kSHAKE256, kAlgoCount };
+enum Status : uint8_t { kStatusOk = 0, kStatusBadRequest = 1 };
+
+struct RequestHeader {
+    uint8_t op;
+    uint8_t algo;
+    uint16_t reserved;
+    uint32_t digest_bits;       // SHAKE only (0 - default size)
+    uint64_t length;
+};
+struct ResponseHeader {
+    uint8_t status;
+    uint8_t reserved[3];
+    uint32_t length;
+};
+static_assert(sizeof(RequestHeader) == 16 and sizeof(ResponseHeader) == 8,
+              "sha3d: unexpected header layout");
+
+static constexpr const char* kDefaultSocket = "/tmp/sha3d.sock";
+static constexpr uint32_t kMaxDigestBits = 8192;
+
+//-----------------------------------------------------------------------------
+inline chash::KeccParam algo_param(uint8_t algo)
+{
+    switch (algo) {
+    case kSHA3_224:  return (chash::kSHA3_224);
+    case kSHA3_384:  return (chash::kSHA3_384);
+    case kSHA3_512:  return (chash::kSHA3_512);
+    case kSHAKE128:  return (chash::kSHAKE128);
+    case kSHAKE256:  return (chash::kSHAKE256);
+    default:         return (chash::kSHA3_256);
+    }
+} // end algo_param(...)
+
+//-----------------------------------------------------------------------------
+inline bool read_full(int fd, void* buf, size_t size)
+{
+    char* p = static_cast<char*>(buf);
+    while (size) {
+        ssize_t n = read(fd, p, size);
+        if (n < 0 and EINTR == errno)
+            continue;                   // interrupted by a signal: retry
+        if (n <= 0)
+            return (false);
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return (true);
+} // end read_full(...)
+
+//-----------------------------------------------------------------------------
+inline bool write_full(int fd, const void* buf, size_t size)
+{
+    const char* p = static_cast<const char*>(buf);
+    while (size) {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 and EINTR == errno)
+            continue;
+        if (n <= 0)
+            return (false);
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return (true);
+} // end write_full(...)
+
+
+//====== Client of the daemon (one connection, not thread-safe) ======
+class HashClient
+{
+public:
+    HashClient(const HashClient&) = delete;
+    HashClient& operator=(const HashClient&) = delete;
+
+    explicit HashClient(const std::string& path = kDefaultSocket);
+    ~HashClient()  {  if (fd_ >= 0) close(fd_);  }
+
+    bool connected() const noexcept  {  return (fd_ >= 0);  }
+    bool hash(Algo algo, const void* data, size_t size,
+              std::vector<chash::byte>& digest, uint32_t digest_bits = 0);
+    std::string stats();
+
+private:
+    bool request(const RequestHeader& hdr, const void* data,
+                 std::vector<chash::byte>& reply);
+    int fd_;
+};  // end for class HashClient declaration
+
+//-----------------------------------------------------------------------------
+inline HashClient::HashClient(const std::string& path)
+    :   fd_(-1)
+{
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+        return;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd_ >= 0 and connect(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr))) {
+        close(fd_);
+        fd_ = -1;
+    }
+} // end HashClient(...)
+
+//-----------------------------------------------------------------------------
+inline bool HashClient::request(const RequestHeader& hdr, const void* data,
+                                std::vector<chash::byte>& reply)
+{
+    ResponseHeader resp;
+    if (fd_ < 0 or !write_full(fd_, &hdr, sizeof(hdr))
+            or (hdr.length and !write_full(fd_, data, hdr.length))
+            or !read_full(fd_, &resp, sizeof(resp)))
+        return (false);
+    reply.resize(resp.length);
+    return (read_full(fd_, reply.data(), reply.size())
+            and kStatusOk == resp.status);
+} // end request(...)
+
+//-----------------------------------------------------------------------------
+inline bool HashClient::hash(Algo algo, const void* data, size_t size,
+                             std::vector<chash::byte>& digest,
+                             uint32_t digest_bits)
+{
+    RequestHeader hdr{ kOpHash, algo, 0, digest_bits, size };
+    return (request(hdr, data, digest));
+} // end hash(...)
+
+//-----------------------------------------------
+inline std::string HashClient::stats()
+{   // "name value" lines (see sha3d.cpp)
+    RequestHeader hdr{ kOpStats, 0, 0, 0, 0 };
+    std::vector<chash::byte> reply;
+    if (!request(hdr, nullptr, reply))
+        return (std::string());
+    return (std::string(reply.begin(), reply.end()));
+} // end stats()
+
+//====== end for class HashClient definition ======
+
+} // end namespace "sha3d"
+
+//-----------------------------------------------------------------------------
+#endif /* SHA3D_CLIENT_H_ */
@@ -25,12 +25,32 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //=============================================================================
 
 #include "sha3_ec.h"
+#include "sha3_stream.h"
+#include "sha3md_cache.h"
+#include "sha3md_walk.h"
+#include "sha3md_read.h"
+#include "sha3_merkle.h"
+#include "sha3_cdc.h"
+#include "sha3_format.h"
 
 #include <fstream>
+#include <sstream>
 #include <cstring>
 #include <map>
 #include <memory>
 #include <exception>
+#include <algorithm>
+#include <numeric>
+#include <future>
+#include <iomanip>
+#include <atomic>
+#include <thread>
+#include <mutex>
+
+#if defined(__unix__) or defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 //=============================================================================
 enum ErrCode { kOk = 0, kError};
@@ -44,16 +64,42 @@ static int print_summary(int exit_code)
         << "\n  --help          Display this summary"
         << "\n  -[hash_type]    Hash type : sha3-224, sha3-256, sha3-384"
         << "\n                              sha3-512, shake128, shake256"
+        << "\n                  (may be repeated: each file is read once and"
+        << "\n                  one line per hash type is printed)"
+        << "\n  -par            Feed the hash types on parallel threads"
+        << "\n  -cache idxfile  Reuse digests of unchanged files (same device,"
+        << "\n                  inode, size and mtime) stored in 'idxfile'"
+        << "\n  -no-cache       Recompute all digests (the cache is refreshed)"
+        << "\n  -verify-cache   Recompute and compare with the cached digests"
+        << "\n  -resume         Keep the sponge midstate in 'file.sha3ms' and"
+        << "\n                  hash only the bytes appended since the last run"
+        << "\n  -r              Hash directories recursively (sorted by path)"
+        << "\n  -j threads      Number of walking/hashing threads for '-r'"
+        << "\n  -tree           With '-r': print one Merkle root per directory"
+        << "\n                  argument and hash type, 'SHA3-256-TREE[TYPE]'"
+        << "\n                  (the tree is always SHA3-256, over the TYPE"
+        << "\n                  digests of the files)"
+        << "\n  -chunks         Content-defined chunks of the files (FastCDC):"
+        << "\n                  one line 'TYPE(file)[offset,length]= digest'"
+        << "\n                  per chunk (the first hash type is used)"
+        << "\n  -read mode      Read strategy (POSIX), 'auto' by default or"
+        << "\n                  a comma separated list of: plain, fadvise"
+        << "\n                  (drop hashed pages), direct (O_DIRECT),"
+        << "\n                  sparse (holes are not read)"
         << "\n  -len digestlen  FOR SHAKE ONLY : length of a digest(in bits!)"
         << "\n  -out outfile    Output to file rather than stdout"
         << "\n  -sep 'sep'      Byte separator character in output string"
         << "\n  -u              Output in UPPERCASE (default: lowercase)"
+        << "\n  -base64         Digests in base64 rather than hex"
+        << "\n  -binary         Binary manifest (type, name, digest records;"
+        << "\n                  see sha3_format.h) rather than text lines"
         << "\nEXIT STATUS :"
         << "\n  0               Successful completion"
         << "\n  1               An error occures"
         << "\nEXAMPLES:"
         << "\n  sha3md -sha3-256 -sep ':' file1.bin some_app.exe"
         << "\n  sha3md -shake128 -len 213 -out sha3.sum 'I wanna hashing.pdf'"
+        << "\n  sha3md -sha3-256 -sha3-512 -shake256 -par release.tar"
         << std::endl;
     return (exit_code);
 } // end print_summary()
@@ -65,8 +111,13 @@ class SHA3Hash
     using istream_ptr = std::unique_ptr<std::istream, void (*)(std::istream*)>;
     using ostream_ptr = std::unique_ptr<std::ostream, void (*)(std::ostream*)>;
     using buf_type = std::unique_ptr<char[], std::default_delete<char[]>>;
-    enum ParamCode { len, out, sep, upper, sha3_224, sha3_256, sha3_384,
-                     sha3_512, shake128, shake256, bad_param  };
+    using hasher_list = std::vector<std::unique_ptr<chash::SHA3_IUF>>;
+    using digest_list = std::vector<std::vector<chash::byte>>;
+    enum ParamCode { len, out, sep, upper, base64, binary, par, cache, no_cache, verify_cache,
+                     resume, read_mode, recursive, jobs, tree, chunks, sha3_224, sha3_256, sha3_384, sha3_512, shake128,
+                     shake256, bad_param  };
+    enum CacheMode { kUseCache, kNoCache, kVerifyCache };
+    enum OutFormat { kHex, kBase64, kBinary };
 public:
     SHA3Hash();
    
@@ -76,19 +127,66 @@ private:
     int check_param(const char* arg) const;
     chash::SHA3Param set_hash_type(int hash_type);
     chash::size_t set_length(const std::string &param);
+    static unsigned set_read_mode(const std::string& param);
     int set_input_files();
     int update_hash_from_stream(const istream_ptr& is, buf_type& buffer,
                                 chash::SHA3_IUF& obj);
+    int update_hashes_from_stream(const istream_ptr& is, buf_type& buffer,
+                                  hasher_list& hashers);
+    void print_digests(const std::string& ifname, hasher_list& hashers,
+                       const digest_list& digests);
+    void print_line(const std::string& type, const std::string& ifname,
+                    const chash::byte* digest, chash::size_t size,
+                    const std::string& suffix = "");
+    chash::size_t make_hashers(hasher_list& hashers);
+    int hash_tree(const std::string& root, hasher_list& hashers);
+    istream_ptr open_input(const std::string& path);
+    bool hash_file(const std::string& path, hasher_list& hashers,
+                   buf_type& buffer, digest_list& digests);
+    static bool read_small(const std::string& path, chash::size_t size,
+                           std::vector<char>& arena);
+    int print_chunks(const istream_ptr& is, const std::string& ifname,
+                     buf_type& buffer, chash::SHA3_IUF& obj);
+    chash::size_t load_midstates(const std::string& ifname, hasher_list& hashers);
+    void save_midstates(const std::string& ifname, hasher_list& hashers);
+    static bool tail_digest(const std::string& ifname, chash::size_t offset,
+                            chash::size_t tail_len, std::vector<chash::byte>& sum);
+#ifdef SHA3MD_HAS_CACHE
+    bool make_keys(const std::string& ifname, hasher_list& hashers,
+                   std::vector<sha3md::DigestCache::Key>& keys);
+    bool lookup(const std::vector<sha3md::DigestCache::Key>& keys,
+                digest_list& digests);
+    int refresh_cache(const std::string& ifname, hasher_list& hashers,
+                      const std::vector<sha3md::DigestCache::Key>& keys,
+                      const digest_list& digests);
+#endif
 private:
     std::vector<std::string> input_from_;
     ostream_ptr output_to_;
-    chash::SHA3Param sha3_param_;
+    std::unique_ptr<chash::BufferedWriter> writer_;     // over output_to_
+    std::vector<int> hash_types_;               // in the order of the flags
     chash::size_t hash_length_;
     const chash::size_t mem_page_size_ = 4096;
+    static constexpr chash::size_t kSmallFile = 65536;  // '-r': read whole
+    static constexpr size_t kBatchFiles = 64;           // '-r': files per batch
     chash::size_t block_size_;
     bool ready_;
     bool uppercase_;
+    bool interactive_;                          // flush every line (terminal)
+    OutFormat format_;
+    bool parallel_;
+    bool resume_;
+    bool recursive_;
+    bool tree_digest_;
+    bool chunks_;
+    unsigned jobs_;                             // 0 - hardware concurrency
+    unsigned read_mode_;                        // sha3md::ReadMode flags
     char separator_;
+    std::string cache_path_;                    // empty - no cache
+    CacheMode cache_mode_;
+#ifdef SHA3MD_HAS_CACHE
+    std::unique_ptr<sha3md::DigestCache> cache_;
+#endif
 };  // end class SHA3Hash declaration
 
 //=============================================================================
@@ -120,12 +218,21 @@ int main(int argc, const char* argv[])
 //------ Class SHA3Hash ------
 SHA3Hash::SHA3Hash()
 :   output_to_({ &std::cout, [](auto) {} }),
-    sha3_param_(chash::kSHA3_256),              // default - use SHA3-256
     hash_length_(0),
     block_size_(mem_page_size_),
     ready_(false),
     uppercase_(false),
-    separator_(0)
+    interactive_(false),
+    format_(kHex),
+    parallel_(false),
+    resume_(false),
+    recursive_(false),
+    tree_digest_(false),
+    chunks_(false),
+    jobs_(0),
+    read_mode_(sha3md::kReadAuto),
+    separator_(0),
+    cache_mode_(kUseCache)
 {
     input_from_.push_back("stdin");
 } // end SHA3Hash::SHA3Hash()
@@ -143,7 +250,9 @@ int SHA3Hash::set_param(const int argc, const char* argv[])
         case sha3_512:
         case shake128:
         case shake256:
-            sha3_param_ = set_hash_type(res);
+            if (std::find(hash_types_.begin(), hash_types_.end(), res)
+                    == hash_types_.end())
+                hash_types_.push_back(res);
             ready_ = true;      // Ready to hashing only if hash type specified
             break;
         case len:                           // '-len digestlen'
@@ -158,7 +267,8 @@ int SHA3Hash::set_param(const int argc, const char* argv[])
             break;
         case out:                           // '-out outfile'
             if (((arg_num+1)!= argc) and (argv[arg_num+1][0]!='-')) {
-                output_to_ = { new std::ofstream(argv[arg_num+1], std::ios::out),
+                output_to_ = { new std::ofstream(argv[arg_num+1],
+                                                 std::ios::out | std::ios::binary),
                                         [](std::ostream* p) {delete p; } };
                 if (!(*output_to_)) {
                     std::cerr << "Error opening file '"
@@ -181,6 +291,57 @@ int SHA3Hash::set_param(const int argc, const char* argv[])
         case upper:
             uppercase_ = true;
             break;
+        case base64:
+            format_ = kBase64;
+            break;
+        case binary:
+            format_ = kBinary;
+            break;
+        case par:
+            parallel_ = true;
+            break;
+        case cache:                         // '-cache idxfile'
+            if (((arg_num+1)!= argc) and (argv[arg_num+1][0]!='-')) {
+                cache_path_ = argv[arg_num + 1];
+                arg_num++;
+            }
+            else
+                throw std::string("Cache file not specified! Use 'sha3md --help' for help.");
+            break;
+        case no_cache:
+            cache_mode_ = kNoCache;
+            break;
+        case verify_cache:
+            cache_mode_ = kVerifyCache;
+            break;
+        case resume:
+            resume_ = true;
+            break;
+        case read_mode:                     // '-read mode[,mode...]'
+            if (((arg_num+1)!=argc) and (argv[arg_num+1][0]!='-')) {
+                read_mode_ = set_read_mode(argv[arg_num + 1]);
+                arg_num++;
+            }
+            else
+                throw std::string("Read strategy not specified!");
+            break;
+        case recursive:
+            recursive_ = true;
+            break;
+        case tree:
+            tree_digest_ = true;
+            break;
+        case chunks:
+            chunks_ = true;
+            break;
+        case jobs:                          // '-j threads'
+            if (((arg_num+1)!=argc) and std::isdigit(argv[arg_num+1][0])) {
+                jobs_ = static_cast<unsigned>(set_length(argv[arg_num + 1]));
+                arg_num++;
+            }
+            else
+                throw std::string("Number of threads not specified!");
+            break;
         case bad_param:
             if (ready_) {       // all rest parameters are the filenames
                 input_from_.pop_back();     // delete "stdint"
@@ -207,44 +368,533 @@ int SHA3Hash::print_digest()
         std::cerr << "SHA3 settings not configured!" << std::endl;
         return (kError);
     }
-    chash::SHA3_IUF sha3_obj(sha3_param_);
-
-    if (separator_)
-        sha3_obj.set_separator(separator_);
+    if (chunks_ and chash::Domain::kDomSHAKE == set_hash_type(hash_types_.front()).dom
+            and hash_length_ > chash::ChunkPipeline::kMaxDigest * 8) {
+        std::cerr << "Digest length of '-chunks' is limited to "
+                  << chash::ChunkPipeline::kMaxDigest * 8 << " bits!" << std::endl;
+        return (kError);
+    }
+    hasher_list hashers;
+    chash::size_t rate_lcm = make_hashers(hashers);
+    block_size_ = hashers.back()->get_rate() * mem_page_size_;
+    if (hashers.size() > 1)         // the buffer is a multiple of all rates
+        block_size_ = rate_lcm * ((block_size_ + rate_lcm - 1) / rate_lcm);
 
-    if (hash_length_ != 0)
-        sha3_obj.set_digest_size(hash_length_);
+    // The lines are collected in large blocks (flushed per line only when
+    // printing to a terminal)
+    writer_ = std::make_unique<chash::BufferedWriter>(*output_to_);
+#if defined(__unix__) or defined(__APPLE__)
+    interactive_ = (output_to_.get() == &std::cout) and isatty(STDOUT_FILENO);
+#endif
+    if (kBinary == format_)
+        chash::write_manifest_header(*writer_);
 
-    block_size_ = sha3_obj.get_rate() * mem_page_size_;
+    int result = kOk;
+    if (!cache_path_.empty()) {
+#ifdef SHA3MD_HAS_CACHE
+        cache_ = std::make_unique<sha3md::DigestCache>(cache_path_);
+        if (!cache_->is_open()) {
+            std::cerr << "(" << cache_path_ << ") - Error opening cache file!\n";
+            cache_.reset();
+        }
+#else
+        std::cerr << "Digest cache is not supported on this platform!\n";
+#endif
+    }
 
     buf_type buf = std::make_unique<char[]>(block_size_);
     for (const std::string &ifname : input_from_) { // Input files processing
+        std::error_code ec;
+        if (recursive_ and std::filesystem::is_directory(ifname, ec)) {
+            if (hash_tree(ifname, hashers))
+                result = kError;
+            continue;
+        }
+        digest_list digests(hashers.size());
+#ifdef SHA3MD_HAS_CACHE
+        std::vector<sha3md::DigestCache::Key> keys(hashers.size());
+        bool keyed = cache_ and ("stdin" != ifname)
+                     and make_keys(ifname, hashers, keys);
+        if (keyed and kUseCache == cache_mode_ and lookup(keys, digests)) {
+            print_digests(ifname, hashers, digests);  // unchanged file
+            continue;
+        }
+#endif
         istream_ptr in_stream{ nullptr, [](auto) {} };
         if ("stdin" == ifname)           // If the input file is not specified
             in_stream = { &std::cin, [](auto) {} };    // use standard input
-        else {
-            auto flags = std::ios_base::in | std::ios_base::binary;
-            in_stream = { new std::ifstream(ifname, flags),
-                          [](std::istream* p) { delete p; } };
+        else
+            in_stream = open_input(ifname);
+        if (*in_stream and chunks_) {
+            if (print_chunks(in_stream, ifname, buf, *hashers.front()))
+                result = kError;
         }
-        if (*in_stream) {
-            sha3_obj.init();                // init hash object
-            int res = update_hash_from_stream(in_stream, buf, sha3_obj);
-            if(res)                 // an error occurred when reading from file
-                break;          
-            // print result
-            *output_to_ << sha3_obj.get_hash_type() << "(" << ifname << ")= ";
-            if (uppercase_)
-                *output_to_ << std::uppercase;
-            *output_to_ << sha3_obj << std::endl;
+        else if (*in_stream) {
+            for (auto& sha3_obj : hashers)
+                sha3_obj->init();           // init hash objects
+            if (resume_ and "stdin" != ifname) {    // skip the hashed prefix
+                chash::size_t offset = load_midstates(ifname, hashers);
+                if (offset)
+                    in_stream->seekg(static_cast<std::streamoff>(offset));
+            }
+            int res = (hashers.size() == 1)
+                    ? update_hash_from_stream(in_stream, buf, *hashers.front())
+                    : update_hashes_from_stream(in_stream, buf, hashers);
+            if(res) {               // an error occurred when reading from file
+                result = kError;
+                break;
+            }
+            if (resume_ and "stdin" != ifname)
+                save_midstates(ifname, hashers);
+            for (size_t i = 0; i < hashers.size(); i++)
+                digests[i] = hashers[i]->finalize();
+#ifdef SHA3MD_HAS_CACHE
+            if (keyed and refresh_cache(ifname, hashers, keys, digests))
+                result = kError;            // cached digest mismatch
+#endif
+            print_digests(ifname, hashers, digests);
         }
         else {
             std::cerr << "(" << ifname << ") - Error opening file!\n";
         }
     } // end for(ifname...)
-    return (kOk);
+    writer_->flush();
+    return (result);
 } // end print_digest()
 
+//---------------------------------------------------------------------------
+void SHA3Hash::print_digests(const std::string& ifname, hasher_list& hashers,
+                             const digest_list& digests)
+{   // One line per hash type
+    for (size_t i = 0; i < hashers.size(); i++)
+        print_line(hashers[i]->get_hash_type(), ifname,
+                   digests[i].data(), digests[i].size());
+} // end SHA3Hash::print_digests(...)
+
+//---------------------------------------------------------------------------
+void SHA3Hash::print_line(const std::string& type, const std::string& ifname,
+                          const chash::byte* digest, chash::size_t size,
+                          const std::string& suffix)
+{   // "TYPE(name)suffix= digest" (hex as operator<< of SHA3_IUF, or base64)
+    // formatted straight into the output block; with '-binary' a manifest
+    // record with the name "name" + suffix
+    if (kBinary == format_) {
+        chash::write_manifest_record(*writer_, type, ifname + suffix, digest, size);
+        return;
+    }
+    const size_t text = (kBase64 == format_) ? chash::base64_size(size)
+                                             : chash::hex_size(size, separator_);
+    char* start = writer_->reserve(type.size() + ifname.size() + suffix.size()
+                                   + text + 5);
+    char* p = start;
+    auto append = [&p](const char* str, size_t n) {
+        std::memcpy(p, str, n);
+        p += n;
+    };
+    append(type.data(), type.size());
+    append("(", 1);
+    append(ifname.data(), ifname.size());
+    append(")", 1);
+    append(suffix.data(), suffix.size());
+    append("= ", 2);
+    p = (kBase64 == format_) ? chash::to_base64(digest, size, p)
+                             : chash::to_hex(digest, size, p, uppercase_, separator_);
+    *p++ = '\n';
+    writer_->commit(p - start);
+    if (interactive_)
+        writer_->flush();
+} // end SHA3Hash::print_line(...)
+
+//---------------------------------------------------------------------------
+chash::size_t SHA3Hash::make_hashers(hasher_list& hashers)
+{   // One configured hasher per hash type; returns LCM of the rates (bytes)
+    chash::size_t rate_lcm = 1;
+    for (int hash_type : hash_types_) {
+        hashers.push_back(std::make_unique<chash::SHA3_IUF>(set_hash_type(hash_type)));
+        chash::SHA3_IUF& sha3_obj = *hashers.back();
+        if (separator_)
+            sha3_obj.set_separator(separator_);
+        if (hash_length_ != 0)
+            sha3_obj.set_digest_size(hash_length_);
+        rate_lcm = std::lcm(rate_lcm, sha3_obj.get_rate() / 8);
+    }
+    return (rate_lcm);
+} // end SHA3Hash::make_hashers(...)
+
+//-----------------------------------------------------------------------------
+int SHA3Hash::hash_tree(const std::string& root, hasher_list& hashers)
+{   // '-r' mode: the tree is walked and its files are hashed by <jobs_>
+    // threads (each with its own hashers and buffer); the results are printed
+    // in the order of the relative paths. With '-tree' one line per hash type
+    // is printed instead: the root of a Merkle tree (SHA3-256 nodes) whose
+    // leaves are "relative path | 0 | size (8 bytes LE) | file digest".
+    const unsigned threads = jobs_ ? jobs_
+                           : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::string> errors;
+    std::vector<sha3md::FileEntry> files = sha3md::walk_tree(root, threads, errors);
+    for (const auto& dir : errors)
+        std::cerr << "(" << dir << ") - Error reading directory!\n";
+
+    std::vector<digest_list> digests(files.size());
+    std::vector<char> failed(files.size(), 0);
+    std::atomic<size_t> next{0};
+    std::mutex cache_mtx;               // DigestCache is shared by the threads
+    const bool saved_parallel = parallel_;
+    parallel_ = false;                  // the files are hashed in parallel
+
+    // Small files are taken by batches of kBatchFiles: each file is read
+    // whole (open/read/close) into a reusable arena and the batch is hashed
+    // by the multi-message kernel, one hash_many() call per hash type
+    auto worker = [&]() {
+        hasher_list local;
+        make_hashers(local);
+        buf_type buf;                   // allocated for the first large file
+        std::vector<char> arena;
+        std::vector<size_t> small, offsets;
+        std::vector<const char*> msgs;
+        std::vector<chash::size_t> lens;
+        std::vector<chash::byte*> outs;
+#ifdef SHA3MD_HAS_CACHE
+        std::vector<std::vector<sha3md::DigestCache::Key>> keys;
+        std::vector<char> keyed;
+#endif
+        for (size_t first; (first = next.fetch_add(kBatchFiles)) < files.size(); ) {
+            const size_t last = std::min<size_t>(first + kBatchFiles, files.size());
+            small.clear();
+#ifdef SHA3MD_HAS_CACHE
+            keys.assign(last - first, std::vector<sha3md::DigestCache::Key>(local.size()));
+            keyed.assign(last - first, 0);
+#endif
+            for (size_t i = first; i < last; i++) {
+                digests[i].resize(local.size());
+#ifdef SHA3MD_HAS_CACHE
+                if (cache_) {
+                    std::lock_guard<std::mutex> lock(cache_mtx);
+                    keyed[i - first] = make_keys(files[i].path, local, keys[i - first]);
+                    if (keyed[i - first] and kUseCache == cache_mode_
+                            and lookup(keys[i - first], digests[i]))
+                        continue;
+                }
+#endif
+                if (files[i].size <= kSmallFile)
+                    small.push_back(i);
+                else if (!hash_file(files[i].path, local, buf, digests[i]))
+                    failed[i] = 1;
+            }
+            // Small files: read into the arena (a file that has changed its
+            // size since the walk goes the ordinary way)
+            arena.clear();
+            offsets.clear();
+            size_t count = 0;
+            for (size_t i : small) {
+                size_t offset = arena.size();
+                if (read_small(files[i].path, files[i].size, arena)) {
+                    offsets.push_back(offset);
+                    small[count++] = i;
+                }
+                else if (!hash_file(files[i].path, local, buf, digests[i]))
+                    failed[i] = 1;
+            }
+            for (size_t k = 0; count and k < local.size(); k++) {
+                chash::KeccParam param = set_hash_type(hash_types_[k]);
+                chash::size_t bits = (hash_length_ and chash::Domain::kDomSHAKE == param.dom)
+                                   ? hash_length_ : static_cast<chash::size_t>(param.hash_size);
+                msgs.clear();
+                lens.clear();
+                outs.clear();
+                for (size_t j = 0; j < count; j++) {
+                    std::vector<chash::byte>& d = digests[small[j]][k];
+                    d.resize((bits + 7) / 8);
+                    msgs.push_back(arena.data() + offsets[j]);
+                    lens.push_back(files[small[j]].size);
+                    outs.push_back(d.data());
+                }
+                chash::hash_many(param, msgs.data(), lens.data(), outs.data(), count, bits);
+            }
+#ifdef SHA3MD_HAS_CACHE
+            for (size_t i = first; i < last; i++) {
+                if (keyed[i - first] and !failed[i]) {
+                    std::lock_guard<std::mutex> lock(cache_mtx);
+                    if (refresh_cache(files[i].path, local, keys[i - first], digests[i]))
+                        failed[i] = 2;      // cached digest mismatch
+                }
+            }
+#endif
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < threads; i++)
+        pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool)
+        t.join();
+    parallel_ = saved_parallel;
+
+    int res = errors.empty() ? kOk : kError;
+    for (size_t i = 0; i < files.size(); i++) {
+        if (failed[i]) {
+            if (1 == failed[i])
+                std::cerr << "(" << files[i].path << ") - Error opening file!\n";
+            res = kError;
+        }
+        else if (!tree_digest_)
+            print_digests(files[i].path, hashers, digests[i]);
+    }
+    if (!tree_digest_)
+        return (res);
+    for (size_t k = 0; k < hashers.size(); k++) {
+        std::vector<std::string> leaves;
+        leaves.reserve(files.size());
+        for (size_t i = 0; i < files.size(); i++) {
+            if (failed[i])
+                continue;
+            std::string leaf = files[i].rel;
+            leaf.push_back('\0');
+            for (int b = 0; b < 8; b++)
+                leaf.push_back(static_cast<char>(files[i].size >> (8 * b)));
+            leaf.append(digests[i][k].begin(), digests[i][k].end());
+            leaves.push_back(std::move(leaf));
+        }
+        chash::MerkleTree merkle(threads);
+        merkle.build(leaves);
+        chash::Digest256 top = merkle.root();
+        // the nodes are SHA3-256 whatever the hash type of the files
+        print_line("SHA3-256-TREE[" + hashers[k]->get_hash_type() + "]", root,
+                   top.data(), top.size());
+    }
+    return (res);
+} // end SHA3Hash::hash_tree(...)
+
+//-----------------------------------------------------------------------------
+SHA3Hash::istream_ptr SHA3Hash::open_input(const std::string& path)
+{   // The file through the selected read strategy ('-read'; POSIX), or
+    // an ifstream
+#ifdef SHA3MD_HAS_FILE_READER
+    if (sha3md::kReadPlain != read_mode_)
+        return { new sha3md::FileIStream(path, read_mode_, block_size_),
+                 [](std::istream* p) { delete p; } };
+#endif
+    auto flags = std::ios_base::in | std::ios_base::binary;
+    return { new std::ifstream(path, flags),
+             [](std::istream* p) { delete p; } };
+} // end SHA3Hash::open_input(...)
+
+//-----------------------------------------------------------------------------
+bool SHA3Hash::hash_file(const std::string& path, hasher_list& hashers,
+                         buf_type& buffer, digest_list& digests)
+{   // A file of any size by the streaming hashers (all hash types)
+    istream_ptr in_stream = open_input(path);
+    if (!*in_stream)
+        return (false);
+    if (!buffer)
+        buffer = std::make_unique<char[]>(block_size_);
+    for (auto& sha3_obj : hashers)
+        sha3_obj->init();
+    if ((hashers.size() == 1)
+            ? update_hash_from_stream(in_stream, buffer, *hashers.front())
+            : update_hashes_from_stream(in_stream, buffer, hashers))
+        return (false);
+    for (size_t k = 0; k < hashers.size(); k++)
+        digests[k] = hashers[k]->finalize();
+    return (true);
+} // end SHA3Hash::hash_file(...)
+
+//-----------------------------------------------------------------------------
+bool SHA3Hash::read_small(const std::string& path, chash::size_t size,
+                          std::vector<char>& arena)
+{   // Append the whole file to the arena; false if it can not be read or its
+    // size differs from <size> (the arena is left unchanged then)
+    const size_t offset = arena.size();
+    arena.resize(offset + size + 1);    // +1: detect a grown file
+    size_t got = 0;
+#if defined(__unix__) or defined(__APPLE__)
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        arena.resize(offset);
+        return (false);
+    }
+    for (ssize_t n; got <= size and (n = read(fd, &arena[offset + got], size + 1 - got)) > 0; )
+        got += static_cast<size_t>(n);
+    close(fd);
+#else
+    std::ifstream is(path, std::ios_base::in | std::ios_base::binary);
+    is.read(&arena[offset], size + 1);
+    got = static_cast<size_t>(is.gcount());
+#endif
+    arena.resize(offset + size);
+    if (got != size) {
+        arena.resize(offset);
+        return (false);
+    }
+    return (true);
+} // end SHA3Hash::read_small(...)
+
+//-----------------------------------------------------------------------------
+int SHA3Hash::print_chunks(const istream_ptr& is, const std::string& ifname,
+                           buf_type& buffer, chash::SHA3_IUF& obj)
+{   // '-chunks' mode: the file is split by the FastCDC chunker and the chunks
+    // are hashed in batches (multi-buffer, <jobs_> threads) while reading
+    const std::string type = obj.get_hash_type();
+    std::string suffix;
+    chash::ChunkPipeline pipe([&](const chash::ChunkRecord& rec) {
+            suffix = "[" + std::to_string(rec.offset) + ","
+                   + std::to_string(rec.length) + "]";
+            print_line(type, ifname, rec.digest, pipe.digest_size(), suffix);
+        }, set_hash_type(hash_types_.front()), chash::CDCParams(), jobs_,
+        hash_length_);
+    std::streambuf* src = is->rdbuf();
+    try {
+        for (std::streamsize n; (n = src->sgetn(buffer.get(), block_size_)) > 0; )
+            pipe.feed(buffer.get(), n);
+    }
+    catch (const std::exception&) {
+        std::cerr << "Error reading from file!\n";
+        return (kError);
+    }
+    pipe.finish();
+    return (kOk);
+} // end SHA3Hash::print_chunks(...)
+
+//-----------------------------------------------------------------------------
+// Sidecar file 'file.sha3ms' of the '-resume' mode:
+//   magic "SHA3MDR1" | u64 offset (bytes hashed) | u32 tail length |
+//   u32 count | SHA3-256 of the <tail length> bytes before <offset> |
+//   <count> midstates of SHA3_IUF (SHA3_IUF::kMidstateSize bytes each)
+static const char kSidecarMagic[8] = { 'S','H','A','3','M','D','R','1' };
+static const chash::size_t kTailLen = 4096;     // prefix check (last bytes)
+
+//-----------------------------------------------------------------------------
+bool SHA3Hash::tail_digest(const std::string& ifname, chash::size_t offset,
+                           chash::size_t tail_len, std::vector<chash::byte>& sum)
+{   // SHA3-256 of the <tail_len> bytes of the file preceding <offset>
+    std::ifstream is(ifname, std::ios_base::in | std::ios_base::binary);
+    std::string tail(tail_len, '\0');
+    if (!is.seekg(static_cast<std::streamoff>(offset - tail_len))
+            or !is.read(&tail[0], tail_len))
+        return (false);
+    chash::SHA3 chk(chash::kSHA3_256);
+    sum = chk.get_digest(tail, tail.size() * 8);
+    return (true);
+} // end SHA3Hash::tail_digest(...)
+
+//-----------------------------------------------------------------------------
+chash::size_t SHA3Hash::load_midstates(const std::string& ifname,
+                                       hasher_list& hashers)
+{   // Returns the offset to resume from (0 - hash from the beginning). The
+    // file must be at least as long as before, and the bytes just before the
+    // offset must be unchanged (a cheap check that only appends happened).
+    std::ifstream side(ifname + ".sha3ms", std::ios_base::in | std::ios_base::binary);
+    char magic[sizeof(kSidecarMagic)];
+    uint64_t offset = 0;
+    uint32_t tail_len = 0, count = 0;
+    std::vector<chash::byte> saved_sum(32), sum;
+    if (!side.read(magic, sizeof(magic))
+            or std::memcmp(magic, kSidecarMagic, sizeof(magic))
+            or !side.read(reinterpret_cast<char*>(&offset), sizeof(offset))
+            or !side.read(reinterpret_cast<char*>(&tail_len), sizeof(tail_len))
+            or !side.read(reinterpret_cast<char*>(&count), sizeof(count))
+            or !side.read(reinterpret_cast<char*>(saved_sum.data()), 32)
+            or count != hashers.size() or tail_len > offset or tail_len > kTailLen)
+        return (0);
+    std::ifstream file(ifname, std::ios_base::in | std::ios_base::binary | std::ios_base::ate);
+    if (!file or static_cast<uint64_t>(file.tellg()) < offset
+            or !tail_digest(ifname, offset, tail_len, sum) or sum != saved_sum)
+        return (0);
+    std::vector<chash::byte> record(chash::SHA3_IUF::kMidstateSize);
+    for (auto& sha3_obj : hashers) {
+        if (!side.read(reinterpret_cast<char*>(record.data()), record.size())
+                or !sha3_obj->load_midstate(record.data(), record.size())
+                or sha3_obj->byte_total() != offset) {
+            for (auto& obj : hashers)       // start over
+                obj->init();
+            return (0);
+        }
+    }
+    return (offset);
+} // end SHA3Hash::load_midstates(...)
+
+//-----------------------------------------------------------------------------
+void SHA3Hash::save_midstates(const std::string& ifname, hasher_list& hashers)
+{   // Write the sidecar (before finalize) through a temporary file + rename
+    uint64_t offset = hashers.front()->byte_total();
+    uint32_t tail_len = static_cast<uint32_t>(std::min<uint64_t>(offset, kTailLen));
+    uint32_t count = static_cast<uint32_t>(hashers.size());
+    std::vector<chash::byte> sum;
+    if (!tail_digest(ifname, offset, tail_len, sum))
+        return;
+    std::string side_name = ifname + ".sha3ms";
+    {
+        std::ofstream side(side_name + ".tmp",
+                           std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+        side.write(kSidecarMagic, sizeof(kSidecarMagic));
+        side.write(reinterpret_cast<const char*>(&offset), sizeof(offset));
+        side.write(reinterpret_cast<const char*>(&tail_len), sizeof(tail_len));
+        side.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        side.write(reinterpret_cast<const char*>(sum.data()), sum.size());
+        for (auto& sha3_obj : hashers) {
+            std::vector<chash::byte> record = sha3_obj->save_midstate();
+            side.write(reinterpret_cast<const char*>(record.data()), record.size());
+        }
+        if (!side.flush()) {
+            std::cerr << "(" << side_name << ") - Error writing midstate!\n";
+            return;
+        }
+    }
+    std::rename((side_name + ".tmp").c_str(), side_name.c_str());
+} // end SHA3Hash::save_midstates(...)
+
+#ifdef SHA3MD_HAS_CACHE
+//---------------------------------------------------------------------------
+bool SHA3Hash::make_keys(const std::string& ifname, hasher_list& hashers,
+                         std::vector<sha3md::DigestCache::Key>& keys)
+{   // Cache keys of a regular file, one per hash type
+    for (size_t i = 0; i < hashers.size(); i++) {
+        std::string algo = hashers[i]->get_hash_type();
+        uint32_t bits = (algo.compare(0, 5, "SHAKE") == 0)
+                      ? static_cast<uint32_t>(hash_length_) : 0;
+        if (!sha3md::DigestCache::make_key(ifname, algo, bits, keys[i]))
+            return (false);
+    }
+    return (true);
+} // end SHA3Hash::make_keys(...)
+
+//---------------------------------------------------------------------------
+bool SHA3Hash::lookup(const std::vector<sha3md::DigestCache::Key>& keys,
+                      digest_list& digests)
+{   // true only if all of the hash types are cached
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (!cache_->lookup(keys[i], digests[i]))
+            return (false);
+    }
+    return (true);
+} // end SHA3Hash::lookup(...)
+
+//---------------------------------------------------------------------------
+int SHA3Hash::refresh_cache(const std::string& ifname, hasher_list& hashers,
+                            const std::vector<sha3md::DigestCache::Key>& keys,
+                            const digest_list& digests)
+{   // Store the fresh digests (if the file was not changed while hashing);
+    // in verify mode compare them with the cached ones first
+    int res = kOk;
+    std::vector<sha3md::DigestCache::Key> after(keys.size());
+    bool unchanged = make_keys(ifname, hashers, after);
+    for (size_t i = 0; i < keys.size(); i++) {
+        std::vector<chash::byte> cached;
+        if (kVerifyCache == cache_mode_ and cache_->lookup(keys[i], cached)
+                and cached != digests[i]) {
+            std::cerr << "(" << ifname << ") - " << hashers[i]->get_hash_type()
+                      << " differs from the cached digest!\n";
+            res = kError;
+        }
+        unchanged = unchanged and (after[i].size == keys[i].size)
+                    and (after[i].mtime_ns == keys[i].mtime_ns);
+        if (unchanged)
+            cache_->store(keys[i], digests[i]);
+    }
+    return (res);
+} // end SHA3Hash::refresh_cache(...)
+#endif
+
 //----------------------------------------------
 int SHA3Hash::check_param(const char* arg) const
 {
@@ -253,7 +903,11 @@ int SHA3Hash::check_param(const char* arg) const
         {sha3_224, "-sha3-224"}, {sha3_256, "-sha3-256"},
         {sha3_384, "-sha3-384"}, {sha3_512, "-sha3-512"},
         {shake128, "-shake128"}, {shake256, "-shake256"},
-        {len, "-len"}, {out, "-out"}, {sep, "-sep"}, {upper, "-u"}
+        {len, "-len"}, {out, "-out"}, {sep, "-sep"}, {upper, "-u"},
+        {base64, "-base64"}, {binary, "-binary"},
+        {par, "-par"}, {cache, "-cache"}, {no_cache, "-no-cache"},
+        {verify_cache, "-verify-cache"}, {resume, "-resume"}, {read_mode, "-read"},
+        {recursive, "-r"}, {jobs, "-j"}, {tree, "-tree"}, {chunks, "-chunks"}
     };
     int res = bad_param;
     for (const auto& param : ref_params) {
@@ -284,6 +938,26 @@ chash::SHA3Param SHA3Hash::set_hash_type(int hash_type)
     }
 } // end SHA3Hash::set_hash_type(...)
 
+//-----------------------------------------------------------
+unsigned SHA3Hash::set_read_mode(const std::string& param)
+{   // "auto" or a comma separated list of "plain", "fadvise", "direct",
+    // "sparse" (sha3md::ReadMode flags)
+    static const std::map<std::string, unsigned> modes = {
+        {"auto", sha3md::kReadAuto}, {"plain", sha3md::kReadPlain},
+        {"fadvise", sha3md::kReadFadvise}, {"direct", sha3md::kReadDirect},
+        {"sparse", sha3md::kReadSparse}
+    };
+    unsigned mode = sha3md::kReadPlain;
+    std::stringstream list(param);
+    for (std::string name; std::getline(list, name, ','); ) {
+        auto it = modes.find(name);
+        if (modes.end() == it)
+            throw std::string("Unknown read strategy '" + name + "'!");
+        mode |= it->second;
+    }
+    return (mode);
+} // end SHA3Hash::set_read_mode(...)
+
 //---------------------------------------------------
 chash::size_t SHA3Hash::set_length(const std::string &param)
 {
@@ -310,17 +984,58 @@ chash::size_t SHA3Hash::set_length(const std::string &param)
 //---------------------------------------------------------------------------
 int SHA3Hash::update_hash_from_stream(const istream_ptr& is, buf_type &buffer,
                                       chash::SHA3_IUF& obj)
-{
-    while (is->good()) {
-        is->read(buffer.get(), block_size_);
-        if ((is->fail() and !is->eof()) or is->bad()) {
-            std::cerr << "Error reading from file!\n";
-            return (kError);
-        }
-        //obj.update(buffer.get(), is->gcount()); // update hash
-        obj.update_fast(buffer.get(), is->gcount()); // update hash
+{   // The stream buffer absorbs the data straight from the read buffer
+    chash::HashIStreambuf hash_buf(is->rdbuf(), obj, buffer.get(), block_size_);
+    try {
+        hash_buf.consume_all();
+    }
+    catch (const std::exception&) {
+        std::cerr << "Error reading from file!\n";
+        return (kError);
     }
     return (kOk);
 } // end SHA3Hash::update_hash_from_stream()
 
+//---------------------------------------------------------------------------
+int SHA3Hash::update_hashes_from_stream(const istream_ptr& is, buf_type &buffer,
+                                        hasher_list& hashers)
+{   // Single pass for several hash types: every buffer read is fed to all
+    // of the hashers. In parallel mode each hasher gets its own thread and
+    // the next buffer is read while the current one is being hashed.
+    std::streambuf* src = is->rdbuf();
+    buf_type next;
+    std::vector<std::future<void>> jobs;
+    try {
+        if (!parallel_) {
+            for (std::streamsize n; (n = src->sgetn(buffer.get(), block_size_)) > 0; )
+                for (auto& sha3_obj : hashers)
+                    sha3_obj->update_fast(buffer.get(), n);
+            return (kOk);
+        }
+        next = std::make_unique<char[]>(block_size_);
+        std::streamsize n = src->sgetn(buffer.get(), block_size_);
+        while (n > 0) {
+            const char* data = buffer.get();
+            for (auto& sha3_obj : hashers) {
+                chash::SHA3_IUF* obj = sha3_obj.get();
+                jobs.push_back(std::async(std::launch::async,
+                               [obj, data, n] { obj->update_fast(data, n); }));
+            }
+            n = src->sgetn(next.get(), block_size_);    // overlaps hashing
+            for (auto& job : jobs)
+                job.get();
+            jobs.clear();
+            std::swap(buffer, next);
+        }
+    }
+    catch (const std::exception&) {
+        for (auto& job : jobs)          // the jobs still use the buffer
+            if (job.valid())
+                job.wait();
+        std::cerr << "Error reading from file!\n";
+        return (kError);
+    }
+    return (kOk);
+} // end SHA3Hash::update_hashes_from_stream()
+
 //=============================================================================
@@ -0,0 +1,378 @@
+/******************************************************************************
+
+Copyright (c) 2022 Elijah Coleman
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef SHA3MD_CACHE_H_
+#define SHA3MD_CACHE_H_
+
+//-----------------------------------------------------------------------------
+// Persistent digest cache of sha3md (POSIX only).
+// The index file is a memory-mapped open-addressing hash table of fixed-size
+// entries keyed by (device, inode, algorithm); an entry holds the file size
+// and mtime (in ns) the digest was computed for, so a changed file simply
+// misses and its entry is overwritten. Every run stamps the entries it uses
+// with a new generation; a full probe sequence evicts the least recently
+// used entry, so the entries of deleted files age out. When the evicted
+// entry was used by the current run the table is too small for the tree:
+// it is doubled (up to kMaxCapacity) and the entries are rehashed.
+// Concurrent sha3md processes serialize on flock() of the index file; a
+// process that finds a grown table maps the new size.
+
+#if defined(__unix__) or defined(__APPLE__)
+#define SHA3MD_HAS_CACHE 1
+
+#include "sha3_ec.h"
+
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace sha3md
+{
+//====== Memory-mapped digest cache ======
+class DigestCache
+{
+public:
+    struct Key {
+        uint64_t dev, ino, size, mtime_ns;
+        char algo[12];                  // e.g. "SHAKE128"
+        uint32_t digest_bits;           // output length (SHAKE), 0 for SHA3
+    };
+
+    DigestCache(const DigestCache&) = delete;
+    DigestCache& operator=(const DigestCache&) = delete;
+
+    explicit DigestCache(const std::string& path,
+                         uint32_t capacity = kDefaultCapacity);
+    ~DigestCache();
+
+    bool is_open() const noexcept  {  return (nullptr != table_);  }
+    static bool make_key(const std::string& fname, const std::string& algo,
+                         uint32_t digest_bits, Key& key);
+    bool lookup(const Key& key, std::vector<chash::byte>& digest);
+    void store(const Key& key, const std::vector<chash::byte>& digest);
+
+    static constexpr uint32_t kDefaultCapacity = 16384;     // entries
+    static constexpr uint32_t kMaxCapacity = 1u << 24;      // 2 GB index
+    static constexpr size_t kMaxDigest = 64;    // longer digests are not cached
+    static constexpr uint32_t kProbe = 16;      // linear probing limit
+
+private:
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t capacity;
+        uint64_t generation;            // incremented by every run
+    };
+    struct Entry {
+        uint64_t dev, ino, size, mtime_ns;
+        uint64_t used;                  // generation of the last use (0 - free)
+        char algo[12];
+        uint32_t digest_bits;
+        uint32_t digest_len;
+        uint32_t reserved;
+        chash::byte digest[kMaxDigest];
+    };
+
+    class Lock {                        // flock() guard
+    public:
+        Lock(int fd, int op) : fd_(fd)  {  flock(fd_, op);  }
+        ~Lock()  {  flock(fd_, LOCK_UN);  }
+    private:
+        int fd_;
+    };
+
+    Entry* slot(const Key& key, uint32_t probe) const noexcept;
+    Entry* find_slot(const Key& key) const noexcept;
+    static bool same_file(const Entry& e, const Key& key) noexcept;
+    static Key key_of(const Entry& e) noexcept;
+    bool map(uint32_t capacity) noexcept;
+    bool remap() noexcept;
+    bool grow();
+
+    //------ Class Data Members ------
+    int fd_;
+    uint32_t capacity_;                 // of the mapped table
+    size_t map_size_;
+    Header* header_;
+    Entry* table_;
+    uint64_t generation_;
+};  // end for class DigestCache declaration
+
+static constexpr char kCacheMagic[8] = { 'S','H','A','3','M','D','C','\0' };
+static constexpr uint32_t kCacheVersion = 1;
+
+//-----------------------------------------------------------------------------
+inline DigestCache::DigestCache(const std::string& path, uint32_t capacity)
+    :   fd_(-1), capacity_(0), map_size_(0), header_(nullptr), table_(nullptr),
+        generation_(0)
+{
+    fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0)
+        return;
+    Lock lock(fd_, LOCK_EX);
+    struct stat st;
+    if (fstat(fd_, &st) != 0)
+        return;
+    Header hdr{};
+    bool fresh = (static_cast<size_t>(st.st_size) < sizeof(Header))
+              or (pread(fd_, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+              or std::memcmp(hdr.magic, kCacheMagic, sizeof(kCacheMagic))
+              or (hdr.version != kCacheVersion) or (hdr.capacity == 0)
+              or (static_cast<uint64_t>(st.st_size) != sizeof(Header)
+                  + sizeof(Entry) * static_cast<uint64_t>(hdr.capacity));
+    if (!fresh)
+        capacity = hdr.capacity;        // matches the file size
+    if (fresh) {    // new (or foreign / damaged) index: an empty table
+        if (ftruncate(fd_, 0) != 0 or ftruncate(fd_, sizeof(Header)
+                + sizeof(Entry) * static_cast<size_t>(capacity)) != 0)
+            return;
+    }
+    if (!map(capacity))
+        return;
+    if (fresh) {
+        std::memcpy(header_->magic, kCacheMagic, sizeof(kCacheMagic));
+        header_->version = kCacheVersion;
+        header_->capacity = capacity;
+        header_->generation = 0;
+    }
+    generation_ = ++header_->generation;
+} // end DigestCache(...)
+
+//-----------------------------------
+inline DigestCache::~DigestCache()
+{
+    if (nullptr != header_)
+        munmap(header_, map_size_);
+    if (fd_ >= 0)
+        close(fd_);
+} // end ~DigestCache()
+
+//-----------------------------------------------------------------------------
+inline bool DigestCache::map(uint32_t capacity) noexcept
+{   // (Re)map the index file as a table of <capacity> entries
+    size_t map_size = sizeof(Header) + sizeof(Entry) * static_cast<size_t>(capacity);
+    void* p = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (MAP_FAILED == p)
+        return (false);
+    if (nullptr != header_)
+        munmap(header_, map_size_);
+    header_ = static_cast<Header*>(p);
+    table_ = reinterpret_cast<Entry*>(header_ + 1);
+    capacity_ = capacity;
+    map_size_ = map_size;
+    return (true);
+} // end map(...)
+
+//-----------------------------------------------------------------------------
+inline bool DigestCache::remap() noexcept
+{   // Under the lock: follow a table grown by another process
+    if (header_->capacity == capacity_)
+        return (true);
+    struct stat st;
+    if (fstat(fd_, &st) != 0 or static_cast<uint64_t>(st.st_size)
+            != sizeof(Header) + sizeof(Entry) * static_cast<uint64_t>(header_->capacity))
+        return (false);
+    return (map(header_->capacity));
+} // end remap()
+
+//-----------------------------------------------------------------------------
+inline bool DigestCache::grow()
+{   // Under the lock: double the table and rehash the valid entries; false
+    // (the table is not changed) at kMaxCapacity or if the file can not grow
+    if (capacity_ >= kMaxCapacity)
+        return (false);
+    const uint32_t old_capacity = capacity_;
+    std::vector<Entry> entries;
+    for (uint32_t i = 0; i < old_capacity; i++)
+        if (table_[i].used and table_[i].digest_len <= kMaxDigest)
+            entries.push_back(table_[i]);
+    const size_t old_size = map_size_;
+    if (ftruncate(fd_, sizeof(Header) + sizeof(Entry) * 2 * static_cast<size_t>(old_capacity)) != 0)
+        return (false);
+    if (!map(2 * old_capacity)) {
+        if (ftruncate(fd_, old_size) != 0)
+            header_->capacity = 0;      // inconsistent: re-created by the next run
+        return (false);
+    }
+    std::memset(table_, 0, sizeof(Entry) * static_cast<size_t>(capacity_));
+    header_->capacity = capacity_;
+    for (const Entry& e : entries)
+        *find_slot(key_of(e)) = e;
+    return (true);
+} // end grow()
+
+//-----------------------------------------------------------------------------
+inline bool DigestCache::make_key(const std::string& fname,
+                                  const std::string& algo,
+                                  uint32_t digest_bits, Key& key)
+{   // stat() the file; false for non-regular files (pipes, devices, ...)
+    struct stat st;
+    if (stat(fname.c_str(), &st) != 0 or !S_ISREG(st.st_mode))
+        return (false);
+#if defined(__APPLE__)
+    const struct timespec& mtime = st.st_mtimespec;
+#else
+    const struct timespec& mtime = st.st_mtim;
+#endif
+    key = Key{};
+    key.dev = st.st_dev;
+    key.ino = st.st_ino;
+    key.size = st.st_size;
+    key.mtime_ns = static_cast<uint64_t>(mtime.tv_sec) * 1000000000ULL
+                 + mtime.tv_nsec;
+    std::strncpy(key.algo, algo.c_str(), sizeof(key.algo) - 1);
+    key.digest_bits = digest_bits;
+    return (true);
+} // end make_key(...)
+
+//------------------------------------------------------------------------
+inline DigestCache::Entry* DigestCache::slot(const Key& key,
+                                             uint32_t probe) const noexcept
+{   // Home slot: FNV-1a of (device, inode, algorithm)
+    uint64_t h = 14695981039346656037ULL;
+    auto mix = [&h](const void* p, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            h ^= static_cast<const unsigned char*>(p)[i];
+            h *= 1099511628211ULL;
+        }
+    };
+    mix(&key.dev, sizeof(key.dev));
+    mix(&key.ino, sizeof(key.ino));
+    mix(key.algo, sizeof(key.algo));
+    mix(&key.digest_bits, sizeof(key.digest_bits));
+    return (table_ + (h + probe) % capacity_);
+} // end slot(...)
+
+//---------------------------------------------------------------------------
+inline bool DigestCache::same_file(const Entry& e, const Key& key) noexcept
+{   // A damaged entry (impossible digest length) never matches
+    return (e.used and e.digest_len <= kMaxDigest
+            and e.dev == key.dev and e.ino == key.ino
+            and e.digest_bits == key.digest_bits
+            and std::memcmp(e.algo, key.algo, sizeof(e.algo)) == 0);
+} // end same_file(...)
+
+//-----------------------------------------------------------------------
+inline DigestCache::Key DigestCache::key_of(const Entry& e) noexcept
+{
+    Key key{};
+    key.dev = e.dev;
+    key.ino = e.ino;
+    key.size = e.size;
+    key.mtime_ns = e.mtime_ns;
+    std::memcpy(key.algo, e.algo, sizeof(key.algo));
+    key.digest_bits = e.digest_bits;
+    return (key);
+} // end key_of(...)
+
+//-----------------------------------------------------------------------------
+inline DigestCache::Entry* DigestCache::find_slot(const Key& key) const noexcept
+{   // The slot of the same file, a free/expired slot, or the least recently
+    // used slot of the probe sequence
+    Entry* victim = nullptr;
+    uint64_t victim_used = 0;
+    for (uint32_t i = 0; i < kProbe; i++) {
+        Entry* e = slot(key, i);
+        if (same_file(*e, key))
+            return (e);
+        // free entries have used == 0, damaged ones are free as well
+        uint64_t used = (e->digest_len <= kMaxDigest) ? e->used : 0;
+        if (nullptr == victim or used < victim_used) {
+            victim = e;
+            victim_used = used;
+        }
+    }
+    return (victim);
+} // end find_slot(...)
+
+//-----------------------------------------------------------------------------
+inline bool DigestCache::lookup(const Key& key, std::vector<chash::byte>& digest)
+{   // Digest of an unchanged file (same size and mtime), refreshes the entry
+    if (!is_open())
+        return (false);
+    Lock lock(fd_, LOCK_EX);
+    if (!remap())
+        return (false);
+    for (uint32_t i = 0; i < kProbe; i++) {
+        Entry* e = slot(key, i);
+        if (!same_file(*e, key))
+            continue;
+        if (e->size != key.size or e->mtime_ns != key.mtime_ns)
+            return (false);             // stale: overwritten by store()
+        digest.assign(e->digest, e->digest + e->digest_len);
+        e->used = generation_;
+        return (true);
+    }
+    return (false);
+} // end lookup(...)
+
+//-----------------------------------------------------------------------------
+inline void DigestCache::store(const Key& key, const std::vector<chash::byte>& digest)
+{   // Put the entry into the slot found by find_slot(); evicting an entry
+    // of the current run grows the table first
+    if (!is_open() or digest.size() > kMaxDigest)
+        return;
+    // A file modified within the mtime granularity of now could change again
+    // without changing its mtime ("racy" entry): do not cache it
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t now_ns = static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + now.tv_nsec;
+    if (key.mtime_ns + 2000000000ULL > now_ns)
+        return;
+    Lock lock(fd_, LOCK_EX);
+    if (!remap())
+        return;
+    Entry* victim = find_slot(key);
+    if (!same_file(*victim, key) and generation_ == victim->used and grow())
+        victim = find_slot(key);
+    Entry entry{};
+    entry.dev = key.dev;
+    entry.ino = key.ino;
+    entry.size = key.size;
+    entry.mtime_ns = key.mtime_ns;
+    entry.used = generation_;
+    std::memcpy(entry.algo, key.algo, sizeof(entry.algo));
+    entry.digest_bits = key.digest_bits;
+    entry.digest_len = static_cast<uint32_t>(digest.size());
+    std::memcpy(entry.digest, digest.data(), digest.size());
+    *victim = entry;
+} // end store(...)
+
+//====== end for class DigestCache definition ======
+
+} // end namespace "sha3md"
+
+#endif // POSIX
+
+//-----------------------------------------------------------------------------
+#endif /* SHA3MD_CACHE_H_ */
@@ -0,0 +1,339 @@
+/******************************************************************************
+
+Copyright (c) 2022 Elijah Coleman
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef SHA3MD_READ_H_
+#define SHA3MD_READ_H_
+
+//-----------------------------------------------------------------------------
+// Read strategies of sha3md for large and cold files (POSIX only).
+// FileStreambuf is an input stream buffer over a file descriptor:
+//  - kReadFadvise: sequential readahead hint, the pages already hashed are
+//    dropped from the page cache (POSIX_FADV_DONTNEED);
+//  - kReadDirect: O_DIRECT reads into an aligned buffer, bypassing the page
+//    cache (falls back to kReadFadvise where the file system refuses it);
+//  - kReadSparse: holes are found by SEEK_DATA/SEEK_HOLE and served from a
+//    static zero page without any I/O.
+// kReadAuto picks the strategy by the file type, size and allocated blocks.
+
+namespace sha3md
+{
+//------ Read strategy flags (may be combined) ------
+enum ReadMode : unsigned {
+    kReadPlain = 0,             // read() through the page cache
+    kReadFadvise = 1,           // readahead hint, drop the hashed pages
+    kReadDirect = 2,            // O_DIRECT
+    kReadSparse = 4,            // skip holes (SEEK_DATA/SEEK_HOLE)
+    kReadAuto = 8               // chosen by the file (see choose_read_mode)
+};
+} // end namespace "sha3md"
+
+#if defined(__unix__) or defined(__APPLE__)
+#define SHA3MD_HAS_FILE_READER 1
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <istream>
+#include <streambuf>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace sha3md
+{
+static constexpr uint64_t kFadviseMinSize = uint64_t(64) << 20;  // 64 MB
+static constexpr uint64_t kDirectMinSize = uint64_t(1) << 30;    // 1 GB
+
+//-----------------------------------------------------------------------------
+inline unsigned choose_read_mode(const struct stat& st) noexcept
+{   // Pipes and devices - plain reads; regular files: holes are skipped if
+    // fewer blocks are allocated than the size needs, large files bypass or
+    // do not keep the page cache
+    if (!S_ISREG(st.st_mode))
+        return (kReadPlain);
+    unsigned mode = kReadPlain;
+    const uint64_t size = static_cast<uint64_t>(st.st_size);
+    if (static_cast<uint64_t>(st.st_blocks) * 512 < size)
+        mode |= kReadSparse;
+    if (size >= kDirectMinSize)
+        mode |= kReadDirect;
+    else if (size >= kFadviseMinSize)
+        mode |= kReadFadvise;
+    return (mode);
+} // end choose_read_mode(...)
+
+//====== File input stream buffer ======
+class FileStreambuf : public std::streambuf
+{
+public:
+    FileStreambuf(const FileStreambuf&) = delete;
+    FileStreambuf& operator=(const FileStreambuf&) = delete;
+
+    // <block_size> - bytes per read (a multiple of kAlign for kReadDirect)
+    FileStreambuf(const std::string& path, unsigned mode, size_t block_size);
+    ~FileStreambuf() override;
+
+    bool is_open() const noexcept  {  return (fd_ >= 0);  }
+    unsigned mode() const noexcept  {  return (mode_);  }  // effective one
+    uint64_t hole_bytes() const noexcept  {  return (hole_bytes_);  }
+    bool error() const noexcept  {  return (error_);  }     // a read failed
+
+    static constexpr size_t kAlign = 4096;      // O_DIRECT alignment
+    static constexpr size_t kZeroPage = 1 << 16;
+
+protected:
+    int_type underflow() override;
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                     std::ios_base::openmode which) override;
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+
+private:
+    static char* zero_page() noexcept;
+    ssize_t read_at(uint64_t pos, size_t len, char*& data);
+    void drop_consumed() noexcept;
+
+    //------ Class Data Members ------
+    int fd_;
+    unsigned mode_;
+    bool regular_;
+    char* buf_;                 // kAlign-aligned, block_ + kAlign bytes
+    size_t block_;
+    uint64_t size_;             // of a regular file
+    uint64_t pos_;              // file offset of the end of the get area
+    uint64_t data_end_;         // end of the current data region (kReadSparse)
+    uint64_t dropped_;          // pages before it are dropped (kReadFadvise)
+    uint64_t hole_bytes_;
+    bool error_;
+};  // end for class FileStreambuf declaration
+
+//-----------------------------------------------------------------------------
+inline FileStreambuf::FileStreambuf(const std::string& path, unsigned mode,
+                                    size_t block_size)
+:   fd_(-1), mode_(kReadPlain), regular_(false), buf_(nullptr),
+    block_((block_size + kAlign - 1) / kAlign * kAlign), size_(0), pos_(0),
+    data_end_(0), dropped_(0), hole_bytes_(0), error_(false)
+{
+    fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd_ < 0 or fstat(fd_, &st)) {
+        if (fd_ >= 0)
+            close(fd_);
+        fd_ = -1;
+        return;
+    }
+    regular_ = S_ISREG(st.st_mode);
+    size_ = static_cast<uint64_t>(st.st_size);
+    mode_ = (mode & kReadAuto) ? choose_read_mode(st)
+          : (regular_ ? mode : kReadPlain);
+#if defined(O_DIRECT)
+    if ((mode_ & kReadDirect)
+            and fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) | O_DIRECT))
+        mode_ = (mode_ & ~kReadDirect) | kReadFadvise;
+#else
+    if (mode_ & kReadDirect)
+        mode_ = (mode_ & ~kReadDirect) | kReadFadvise;
+#endif
+#if !defined(SEEK_DATA)
+    mode_ &= ~kReadSparse;
+#endif
+#if defined(POSIX_FADV_SEQUENTIAL)
+    if (mode_ & kReadFadvise)
+        posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+#else
+    mode_ &= ~kReadFadvise;
+#endif
+    void* p = nullptr;
+    if (posix_memalign(&p, kAlign, block_ + kAlign)) {
+        close(fd_);
+        fd_ = -1;
+        return;
+    }
+    buf_ = static_cast<char*>(p);
+    setg(buf_, buf_, buf_);
+} // end FileStreambuf(...)
+
+//--------------------------------------------
+inline FileStreambuf::~FileStreambuf()
+{   // The whole range read is dropped once more: pages still queued for
+    // the LRU lists while reading were skipped by the kernel
+    dropped_ = 0;
+    drop_consumed();
+    if (fd_ >= 0)
+        close(fd_);
+    std::free(buf_);
+} // end ~FileStreambuf()
+
+//--------------------------------------------
+inline char* FileStreambuf::zero_page() noexcept
+{   // Read-only for the readers of the get area (putback is not supported)
+    alignas(4096) static char zeros[kZeroPage] = {};
+    return (zeros);
+} // end zero_page()
+
+//--------------------------------------------
+inline void FileStreambuf::drop_consumed() noexcept
+{   // kReadFadvise: the pages hashed so far are not needed any more
+#if defined(POSIX_FADV_DONTNEED)
+    if ((mode_ & kReadFadvise) and fd_ >= 0 and pos_ > dropped_) {
+        posix_fadvise(fd_, static_cast<off_t>(dropped_),
+                      static_cast<off_t>(pos_ - dropped_), POSIX_FADV_DONTNEED);
+        dropped_ = pos_;
+    }
+#endif
+} // end drop_consumed()
+
+//-----------------------------------------------------------------------------
+inline ssize_t FileStreambuf::read_at(uint64_t pos, size_t len, char*& data)
+{   // Up to <len> bytes from <pos>; O_DIRECT reads are widened to aligned
+    // offsets and lengths, <data> points to the requested bytes
+    if (!regular_) {
+        data = buf_;
+        return (read(fd_, buf_, len));
+    }
+    if (mode_ & kReadDirect) {
+        const uint64_t start = pos / kAlign * kAlign;
+        const size_t skip = static_cast<size_t>(pos - start);
+        const size_t span = (skip + len + kAlign - 1) / kAlign * kAlign;
+        ssize_t got = pread(fd_, buf_, span, static_cast<off_t>(start));
+        if (got < 0 and EINVAL == errno) {      // refused: buffered reads
+#if defined(O_DIRECT)
+            fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) & ~O_DIRECT);
+#endif
+            mode_ = (mode_ & ~kReadDirect) | kReadFadvise;
+            return (read_at(pos, len, data));
+        }
+        data = buf_ + skip;
+        if (got <= static_cast<ssize_t>(skip))
+            return (got < 0 ? got : 0);
+        return (std::min<ssize_t>(got - static_cast<ssize_t>(skip),
+                                  static_cast<ssize_t>(len)));
+    }
+    data = buf_;
+    return (pread(fd_, buf_, len, static_cast<off_t>(pos)));
+} // end read_at(...)
+
+//-----------------------------------------------------------------------------
+inline FileStreambuf::int_type FileStreambuf::underflow()
+{   // The next block: zeros for a hole (no I/O), file data otherwise
+    if (gptr() < egptr())
+        return (traits_type::to_int_type(*gptr()));
+    if (fd_ < 0 or (regular_ and pos_ >= size_))
+        return (traits_type::eof());
+    drop_consumed();
+    size_t len = block_;
+    if (regular_)
+        len = static_cast<size_t>(std::min<uint64_t>(len, size_ - pos_));
+#if defined(SEEK_DATA)
+    if (mode_ & kReadSparse) {
+        if (pos_ >= data_end_) {        // find the next data region
+            off_t data = lseek(fd_, static_cast<off_t>(pos_), SEEK_DATA);
+            uint64_t start = (data < 0) ? size_ : static_cast<uint64_t>(data);
+            if (start > pos_) {         // a hole: served from the zero page
+                size_t n = static_cast<size_t>(std::min<uint64_t>(
+                        start - pos_, kZeroPage));
+                pos_ += n;
+                hole_bytes_ += n;
+                setg(zero_page(), zero_page(), zero_page() + n);
+                return (traits_type::to_int_type(*gptr()));
+            }
+            off_t hole = lseek(fd_, static_cast<off_t>(pos_), SEEK_HOLE);
+            data_end_ = (hole < 0) ? size_ : static_cast<uint64_t>(hole);
+        }
+        len = static_cast<size_t>(std::min<uint64_t>(len, data_end_ - pos_));
+    }
+#endif
+    char* data = nullptr;
+    ssize_t got;
+    do {
+        got = read_at(pos_, len, data);
+    } while (got < 0 and EINTR == errno);
+    if (got < 0) {          // as std::filebuf: reported by an exception
+        error_ = true;
+        throw std::ios_base::failure("FileStreambuf::underflow error reading the file");
+    }
+    if (!got)
+        return (traits_type::eof());
+    pos_ += static_cast<uint64_t>(got);
+    setg(data, data, data + got);
+    return (traits_type::to_int_type(*gptr()));
+} // end underflow()
+
+//-----------------------------------------------------------------------------
+inline FileStreambuf::pos_type FileStreambuf::seekoff(off_type off,
+        std::ios_base::seekdir dir, std::ios_base::openmode which)
+{   // Regular files only; the buffered data is discarded
+    if (!regular_ or !(which & std::ios_base::in))
+        return (pos_type(off_type(-1)));
+    const off_type cur = static_cast<off_type>(pos_) - (egptr() - gptr());
+    off_type target = off;
+    if (std::ios_base::cur == dir)
+        target += cur;
+    else if (std::ios_base::end == dir)
+        target += static_cast<off_type>(size_);
+    if (target < 0)
+        return (pos_type(off_type(-1)));
+    if (target != cur) {
+        drop_consumed();
+        pos_ = static_cast<uint64_t>(target);
+        data_end_ = 0;
+        dropped_ = std::min(dropped_, pos_);
+        setg(buf_, buf_, buf_);
+    }
+    return (pos_type(target));
+} // end seekoff(...)
+
+//-----------------------------------------------------------------------------
+inline FileStreambuf::pos_type FileStreambuf::seekpos(pos_type pos,
+        std::ios_base::openmode which)
+{
+    return (seekoff(off_type(pos), std::ios_base::beg, which));
+} // end seekpos(...)
+//====== end for class FileStreambuf definition ======
+
+//====== Input stream over FileStreambuf ======
+class FileIStream : public std::istream
+{
+public:
+    FileIStream(const std::string& path, unsigned mode, size_t block_size)
+    :   std::istream(nullptr), buf_(path, mode, block_size)
+    {
+        rdbuf(&buf_);
+        if (!buf_.is_open())
+            setstate(std::ios_base::failbit);
+    }
+    FileStreambuf& file() noexcept  {  return (buf_);  }
+
+private:
+    FileStreambuf buf_;
+};  // end for class FileIStream
+
+} // end namespace "sha3md"
+
+#endif // POSIX
+//-----------------------------------------------------------------------------
+#endif /* SHA3MD_READ_H_ */
@@ -0,0 +1,132 @@
+/******************************************************************************
+
+Copyright (c) 2022 Elijah Coleman
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+******************************************************************************/
+
+#ifndef SHA3MD_WALK_H_
+#define SHA3MD_WALK_H_
+
+//-----------------------------------------------------------------------------
+// Parallel directory tree walk of sha3md ('-r' mode).
+// Worker threads take directories from a shared queue, list them and push
+// the subdirectories back; regular files (symbolic links are not followed)
+// are collected with their sizes and returned sorted by the relative path,
+// so the output does not depend on the order of the directory listing.
+// Requires C++17 (<filesystem>).
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace sha3md
+{
+//------ A regular file found by walk_tree() ------
+struct FileEntry {
+    std::string path;           // as passed to open(): root + relative path
+    std::string rel;            // relative to the root, '/' separated
+    uint64_t size;
+};
+
+//-----------------------------------------------------------------------------
+inline std::vector<FileEntry> walk_tree(const std::string& root,
+                                        unsigned threads,
+                                        std::vector<std::string>& errors)
+{   // <errors> - directories which could not be listed
+    namespace fs = std::filesystem;
+    if (0 == threads)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<FileEntry> files;
+    std::deque<fs::path> dirs{ fs::path(root) };
+    std::mutex mtx;
+    std::condition_variable cv;
+    unsigned busy = 0;                  // workers listing a directory
+    const size_t root_len = fs::path(root).generic_string().size();
+
+    auto worker = [&]() {
+        std::vector<FileEntry> local_files;
+        std::vector<fs::path> local_dirs;
+        std::unique_lock<std::mutex> lock(mtx);
+        for (;;) {
+            cv.wait(lock, [&] {  return (!dirs.empty() or 0 == busy);  });
+            if (dirs.empty())
+                break;                  // no work queued, nobody listing
+            fs::path dir = std::move(dirs.front());
+            dirs.pop_front();
+            busy++;
+            lock.unlock();
+
+            std::error_code ec;
+            fs::directory_iterator it(dir, fs::directory_options::skip_permission_denied, ec);
+            for (; !ec and it != fs::directory_iterator(); it.increment(ec)) {
+                fs::file_status st = it->symlink_status(ec);
+                if (ec)
+                    break;
+                if (fs::is_directory(st))
+                    local_dirs.push_back(it->path());
+                else if (fs::is_regular_file(st)) {
+                    std::string path = it->path().generic_string();
+                    std::string rel = path.substr(std::min(path.size(), root_len));
+                    rel.erase(0, rel.find_first_not_of('/'));
+                    uint64_t size = it->file_size(ec);
+                    local_files.push_back({ it->path().string(), rel, ec ? 0 : size });
+                    ec.clear();
+                }
+            }
+
+            lock.lock();
+            if (ec)
+                errors.push_back(dir.string());
+            files.insert(files.end(), std::make_move_iterator(local_files.begin()),
+                         std::make_move_iterator(local_files.end()));
+            dirs.insert(dirs.end(), std::make_move_iterator(local_dirs.begin()),
+                        std::make_move_iterator(local_dirs.end()));
+            local_files.clear();
+            local_dirs.clear();
+            busy--;
+            cv.notify_all();
+        }
+        cv.notify_all();
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < threads; i++)
+        pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool)
+        t.join();
+
+    std::sort(files.begin(), files.end(),
+              [](const FileEntry& a, const FileEntry& b) {  return (a.rel < b.rel);  });
+    return (files);
+} // end walk_tree(...)
+
+} // end namespace "sha3md"
+
+//-----------------------------------------------------------------------------
+#endif /* SHA3MD_WALK_H_ */
@@ -6,8 +6,17 @@
 //==============================================================================
 
 #include "sha3_ec.h"
+#include "sha3_merkle.h"
+#include "sha3_pool.h"
+#include "sha3_ctx.h"
+#include "sha3_stream.h"
+#include "sha3_cdc.h"
+#include "sha3_async.h"
+#include "sha3_drbg.h"
+#include "sha3_format.h"
 
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -283,12 +292,839 @@ void sha3_self_test() // Some simple tests
 
 } // end seft_test()
 
+//-----------------------------------------------------------------------------
+template<typename OneBlockType, chash::size_t kOut = OneBlockType::kDigest8>
+bool check_one_block(chash::SHA3_IUF& obj)
+{   // One-block API vs. generic path for all lengths shorter than the rate
+    std::string msg;
+    for (chash::size_t len = 0; len < OneBlockType::kRate8; len++) {
+        chash::byte digest[kOut] = {};
+        const chash::byte* in = reinterpret_cast<const chash::byte*>(msg.data());
+        OneBlockType::template hash<kOut>(in, len, digest);
+        std::vector<chash::byte> ref = obj.get_digest(msg, len * 8);
+        if (!compare_byte_vectors(ref, std::vector<chash::byte>(digest, digest + kOut)))
+            return (false);
+        msg.push_back(static_cast<char>(len * 7));
+    }
+    return (true);
+} // end check_one_block(...)
+
+//-----------------------------------------------------------------------------
+void one_block_test()
+{
+    std::cout << "\nTest for one-block API:\n";
+    {
+        chash::SHA3_IUF obj(chash::kSHA3_224);
+        std::cout << "  SHA3-224: " << (check_one_block<chash::OneBlockSHA3_224>(obj) ? "OK.\n" : "FAIL!\n");
+        obj.setup(chash::kSHA3_256);
+        std::cout << "  SHA3-256: " << (check_one_block<chash::OneBlockSHA3_256>(obj) ? "OK.\n" : "FAIL!\n");
+        obj.setup(chash::kSHA3_384);
+        std::cout << "  SHA3-384: " << (check_one_block<chash::OneBlockSHA3_384>(obj) ? "OK.\n" : "FAIL!\n");
+        obj.setup(chash::kSHA3_512);
+        std::cout << "  SHA3-512: " << (check_one_block<chash::OneBlockSHA3_512>(obj) ? "OK.\n" : "FAIL!\n");
+        obj.setup(chash::kSHAKE128);
+        obj.set_digest_size(256);
+        std::cout << "  SHAKE128: " << (check_one_block<chash::OneBlockSHAKE128, 32>(obj) ? "OK.\n" : "FAIL!\n");
+        obj.setup(chash::kSHAKE256);
+        obj.set_digest_size(512);
+        std::cout << "  SHAKE256: " << (check_one_block<chash::OneBlockSHAKE256, 64>(obj) ? "OK.\n" : "FAIL!\n");
+    }
+    {   // compile-time lengths
+        chash::SHA3_IUF obj(chash::kSHA3_256);
+        std::string key(64, '\x5A');
+        const chash::byte* in = reinterpret_cast<const chash::byte*>(key.data());
+        auto d32 = chash::OneBlockSHA3_256::digest<32>(in);
+        auto d64 = chash::OneBlockSHA3_256::digest<64>(in);
+        std::vector<chash::byte> ref32 = obj.get_digest(key.substr(0, 32), 256);
+        std::vector<chash::byte> ref64 = obj.get_digest(key, 512);
+        bool res = compare_byte_vectors(ref32, std::vector<chash::byte>(d32.begin(), d32.end()))
+               and compare_byte_vectors(ref64, std::vector<chash::byte>(d64.begin(), d64.end()));
+        std::cout << "  compile-time length: " << (res ? "OK.\n" : "FAIL!\n");
+        chash::byte dummy[32];
+        res = !chash::OneBlockSHA3_256::hash(in, 136, dummy);   // too long
+        std::cout << "  too long message rejected: " << (res ? "OK.\n" : "FAIL!\n");
+    }
+} // end one_block_test()
+
+//-----------------------------------------------------------------------------
+void constexpr_test()
+{
+    std::cout << "\nTest for constexpr SHA3/SHAKE:\n";
+    // evaluated at compile time
+    constexpr auto fox = chash::sha3_256("The quick brown fox jumps over the lazy dog.");
+    static_assert(fox[0] == 0xA8 and fox[1] == 0x0F and fox[31] == 0x4D,
+                  "constexpr SHA3-256 failed!");
+    constexpr auto empty = chash::shake256<64>("");
+    static_assert(empty[0] == 0x46 and empty[63] == 0xBE,
+                  "constexpr SHAKE256 failed!");
+    constexpr auto id = chash::sha3_512(
+        "A string literal longer than the rate of SHA3-512 (72 bytes): "
+        "several blocks are absorbed by the constexpr sponge.");
+
+    const std::string str = "A string literal longer than the rate of SHA3-512 (72 bytes): "
+                            "several blocks are absorbed by the constexpr sponge.";
+    chash::SHA3_IUF obj(chash::kSHA3_512);
+    std::vector<chash::byte> ref = obj.get_digest(str, str.size() * 8);
+    bool res = compare_byte_vectors(ref, std::vector<chash::byte>(id.begin(), id.end()));
+    std::cout << "  compile-time digest: " << (res ? "OK.\n" : "FAIL!\n");
+
+    res = true;                 // the same functions at runtime
+    obj.setup(chash::kSHAKE128);
+    obj.set_digest_size(2000);
+    for (size_t len = 0; len < 400; len += 7) {
+        std::string msg(len, static_cast<char>(len + 1));
+        auto dgst = chash::shake128<250>(msg.data(), msg.size());
+        ref = obj.get_digest(msg, len * 8);
+        res = res and compare_byte_vectors(ref,
+                        std::vector<chash::byte>(dgst.begin(), dgst.end()));
+    }
+    std::cout << "  runtime evaluation: " << (res ? "OK.\n" : "FAIL!\n");
+} // end constexpr_test()
+
+//-----------------------------------------------------------------------------
+template<chash::size_t N>
+bool check_shake_mb(const chash::KeccParam& param)
+{   // N streams "seed || i", squeezed in pieces, vs. the scalar SHAKE
+    const chash::size_t pieces[] = { 5, 3, 168 * 2 + 1, 500, 16 };
+    chash::size_t total = 0;
+    for (chash::size_t piece : pieces)
+        total += piece;
+    std::string seeds[N];
+    const chash::byte* in[N];
+    std::vector<chash::byte> outs[N];
+    for (chash::size_t k = 0; k < N; k++) {
+        seeds[k] = std::string(230, '\x33') + char(k);  // longer than the rate
+        in[k] = reinterpret_cast<const chash::byte*>(seeds[k].data());
+        outs[k].resize(total);
+    }
+    chash::ShakeMB<N> sponge(param);
+    sponge.absorb(in, seeds[0].size());
+    chash::size_t done = 0;
+    for (chash::size_t piece : pieces) {
+        chash::byte* out[N];
+        for (chash::size_t k = 0; k < N; k++)
+            out[k] = outs[k].data() + done;
+        sponge.squeeze(out, piece);
+        done += piece;
+        if (done == pieces[0]) {        // ignored once squeezing
+            sponge.absorb(in, seeds[0].size());
+            sponge.finalize();
+        }
+    }
+    chash::SHA3_IUF obj(param);
+    obj.set_digest_size(total * 8);
+    for (chash::size_t k = 0; k < N; k++)
+        if (!compare_byte_vectors(outs[k], obj.get_digest(seeds[k], seeds[k].size() * 8)))
+            return (false);
+    return (true);
+} // end check_shake_mb(...)
+
+//-----------------------------------------------------------------------------
+void absorb_blocks_test()
+{   // Fused multi-block kernel (update_fast) against byte-by-byte update()
+    std::cout << "\nTest for fused multi-block absorption:\n";
+    const chash::KeccParam params[] = { chash::kSHA3_224, chash::kSHA3_256,
+            chash::kSHA3_384, chash::kSHA3_512, chash::kSHAKE128, chash::kSHAKE256 };
+    std::string msg(5000, '\0');
+    for (size_t i = 0; i < msg.size(); i++)
+        msg[i] = static_cast<char>(i * 131 + 7);
+    for (const auto& param : params) {
+        bool res = true;
+        std::string name;
+        for (size_t len : { 0, 71, 72, 136, 1000, 4999 }) {
+            chash::SHA3_IUF ref(param), fast(param);
+            ref.update(msg.data(), len);
+            fast.update_fast(msg.data(), len);
+            fast.update_fast(msg.data() + len, msg.size() - len);
+            ref.update(msg.data() + len, msg.size() - len);
+            std::vector<chash::byte> expected = ref.finalize();
+            res = res and compare_byte_vectors(expected, fast.finalize());
+            name = fast.get_hash_type();
+        }
+        std::cout << "  " << name << ": " << (res ? "OK.\n" : "FAIL!\n");
+    }
+} // end absorb_blocks_test()
+
+//-----------------------------------------------------------------------------
+void scatter_gather_test()
+{   // Fragmented message against the contiguous one
+    std::cout << "\nTest for scatter-gather update:\n";
+    std::string msg(3000, '\0');
+    for (size_t i = 0; i < msg.size(); i++)
+        msg[i] = static_cast<char>(i * 29 + 11);
+    std::vector<std::string> segments;
+    for (size_t pos = 0, i = 0; pos < msg.size(); i++) {  // 0..220 bytes
+        size_t len = std::min<size_t>((i * 53) % 221, msg.size() - pos);
+        segments.push_back(msg.substr(pos, len));
+        pos += len;
+    }
+    const chash::KeccParam params[] = { chash::kSHA3_256, chash::kSHAKE128 };
+    for (const auto& param : params) {
+        chash::SHA3_IUF ref(param), obj(param);
+        std::vector<chash::byte> expected = ref.get_digest(msg, msg.size() * 8);
+        bool res = (obj.update_segments(segments) == msg.size());
+        res = res and compare_byte_vectors(expected, obj.finalize());
+#if defined(__unix__) or defined(__APPLE__)
+        std::vector<iovec> iov;
+        for (auto& seg : segments)
+            iov.push_back({ &seg[0], seg.size() });
+        obj.init();
+        res = res and (obj.update(iov.data(), static_cast<int>(iov.size())) == msg.size());
+        res = res and compare_byte_vectors(expected, obj.finalize());
+#endif
+        std::cout << "  " << obj.get_hash_type() << ": " << (res ? "OK.\n" : "FAIL!\n");
+    }
+} // end scatter_gather_test()
+
+//-----------------------------------------------------------------------------
+void midstate_test()
+{   // Save the midstate, resume in another object, reject damaged records
+    std::cout << "\nTest for midstate serialization:\n";
+    std::string msg(1000, '\0');
+    for (size_t i = 0; i < msg.size(); i++)
+        msg[i] = static_cast<char>(i * 7 + 5);
+    const chash::KeccParam params[] = { chash::kSHA3_512, chash::kSHAKE256 };
+    for (const auto& param : params) {
+        chash::SHA3_IUF ref(param), first(param), second(param);
+        ref.set_digest_size(1000);
+        first.set_digest_size(1000);
+        second.set_digest_size(1000);
+        std::vector<chash::byte> expected = ref.get_digest(msg, msg.size() * 8);
+        first.update_fast(msg.data(), 613);         // not a block boundary
+        std::vector<chash::byte> record = first.save_midstate();
+        bool res = (record.size() == chash::SHA3_IUF::kMidstateSize);
+        res = res and second.load_midstate(record.data(), record.size());
+        res = res and (second.byte_total() == 613);
+        second.update(msg.data() + 613, msg.size() - 613);
+        res = res and compare_byte_vectors(expected, second.finalize());
+        record[100] ^= 1;                           // damaged state
+        res = res and !second.load_midstate(record.data(), record.size());
+        record[100] ^= 1;
+        chash::SHA3_IUF other(chash::kSHA3_256);    // other parameters
+        res = res and !other.load_midstate(record.data(), record.size());
+        chash::SHA3_IUF resized(param);             // other SHAKE digest size
+        if (resized.set_digest_size(512)) {
+            std::vector<chash::byte> before = resized.save_midstate();
+            res = res and !resized.load_midstate(record.data(), record.size())
+                      and resized.save_midstate() == before;
+        }
+        std::cout << "  " << ref.get_hash_type() << ": " << (res ? "OK.\n" : "FAIL!\n");
+    }
+} // end midstate_test()
+
+//--------------
+void duplex_test()
+{   // A duplex call per message: the 1st output matches the sponge, the
+    // outputs depend on the framing of the transcript and on the ratchet
+    std::cout << "\nTest for the duplex construction:\n";
+    const chash::KeccParam params[] = { chash::kSHAKE128, chash::kSHA3_256 };
+    for (const auto& param : params) {
+        chash::SHA3_Duplex dup(param), other(param);
+        chash::SHA3_IUF ref(param);
+        std::string msg = "transcript message";
+        ref.set_digest_size(32 * 8);
+        bool res = (ref.get_digest(msg, msg.size() * 8) == dup.duplex(msg, 32));
+        // "ab" + "c" differs from "a" + "bc"
+        dup.init();
+        dup.duplex("ab", 0);
+        other.duplex("a", 0);
+        std::vector<chash::byte> c1 = dup.duplex("c", 32), c2 = other.duplex("bc", 32);
+        res = res and c1.size() == 32 and c1 != c2;
+        // absorb_bytes() of a long message and squeeze_bytes() are chains
+        // of duplex calls
+        std::string big(500, 'x');
+        dup.init();
+        other.init();
+        dup.absorb_bytes(reinterpret_cast<const chash::byte*>(big.data()), big.size());
+        for (size_t done = 0; done < big.size(); done += other.max_input())
+            other.duplex(big.substr(done, other.max_input()), 0);
+        std::vector<chash::byte> s1(300), s2;
+        dup.squeeze_bytes(s1.data(), s1.size());
+        for (size_t done = 0; done < s1.size(); done += other.max_output()) {
+            std::vector<chash::byte> part = other.duplex("", std::min<size_t>(
+                    s1.size() - done, other.max_output()));
+            s2.insert(s2.end(), part.begin(), part.end());
+        }
+        res = res and s1 == s2;
+        // the ratchet changes the following outputs
+        dup.ratchet();
+        res = res and dup.duplex("m", 32) != other.duplex("m", 32);
+        // too long input
+        res = res and dup.duplex(std::string(dup.max_input() + 1, 'y'), 0).empty()
+                  and !dup.duplex(nullptr, 0, nullptr, dup.max_output() + 1);
+        std::cout << "  " << ref.get_hash_type() << ": " << (res ? "OK.\n" : "FAIL!\n");
+    }
+} // end duplex_test()
+
+//------------
+void drbg_test()
+{   // The output stream is SHAKE(seed) however it is requested
+    std::cout << "\nTest for the SHAKE DRBG:\n";
+    const std::string seed = "fixture seed";
+    const chash::KeccParam params[] = { chash::kSHAKE256, chash::kSHAKE128 };
+    for (const auto& param : params) {
+        chash::SHA3_IUF ref(param);
+        ref.set_digest_size(1000 * 8);
+        std::vector<chash::byte> expected = ref.get_digest(seed, seed.size() * 8);
+        chash::ShakeDRBG drbg(seed, param), same(seed, param);
+        std::vector<chash::byte> out = drbg.bytes(5);   // mixed requests
+        uint64_t word = drbg.next_u64();
+        out.insert(out.end(), reinterpret_cast<chash::byte*>(&word),
+                   reinterpret_cast<chash::byte*>(&word) + sizeof(word));
+        std::vector<chash::byte> rest = drbg.bytes(1000 - out.size());
+        out.insert(out.end(), rest.begin(), rest.end());
+        bool res = (out == expected);
+        // reseed: deterministic, changes the stream
+        same.generate(rest.data(), 1000);
+        drbg.reseed("extra", 5);
+        same.reseed("extra", 5);
+        res = res and (drbg.next_u64() == same.next_u64());
+        res = res and (drbg.bytes(32) != chash::ShakeDRBG(seed, param).bytes(32));
+        // helpers
+        for (int i = 0; i < 1000 and res; i++) {
+            double d = drbg.next_double();
+            float f = drbg.next_float();
+            res = (drbg.uniform(10) < 10) and d >= 0 and d < 1 and f >= 0 and f < 1;
+        }
+        chash::ShakeDRBG child = drbg.split();
+        res = res and (child.next_u64() != drbg.next_u64());
+        std::cout << "  " << ref.get_hash_type() << ": " << (res ? "OK.\n" : "FAIL!\n");
+    }
+    bool res = (&chash::ShakeDRBG::local() == &chash::ShakeDRBG::local());
+    std::cout << "  thread-local instance: " << (res ? "OK.\n" : "FAIL!\n");
+} // end drbg_test()
+
+//--------------
+void format_test()
+{   // Hex and base64 formatting, buffered writer, binary manifest
+    std::cout << "\nTest for digest formatting:\n";
+    const std::vector<chash::byte> bytes = { 0x00, 0x9F, 0xA5, 0xFF };
+    bool res = (chash::to_hex(bytes) == "009fa5ff")
+           and (chash::to_hex(bytes, true, ':') == "00:9F:A5:FF");
+    chash::SHA3_IUF obj;
+    obj.update("abc", 3);
+    std::ostringstream os;
+    os << std::uppercase << obj;
+    obj.init();
+    obj.update("abc", 3);
+    res = res and (os.str() == chash::to_hex(obj.finalize(), true));
+    std::cout << "  hex: " << (res ? "OK.\n" : "FAIL!\n");
+
+    const char* plain[] = { "", "f", "fo", "foo", "foob", "fooba", "foobar" };
+    const char* coded[] = { "", "Zg==", "Zm8=", "Zm9v", "Zm9vYg==", "Zm9vYmE=", "Zm9vYmFy" };
+    res = true;
+    for (int i = 0; i < 7; i++)
+        res = res and (chash::to_base64(std::vector<chash::byte>(plain[i],
+                       plain[i] + std::strlen(plain[i]))) == coded[i]);
+    std::cout << "  base64 (RFC 4648 vectors): " << (res ? "OK.\n" : "FAIL!\n");
+
+    std::ostringstream text, bin;
+    std::string expected;
+    {
+        chash::BufferedWriter writer(text, 16);     // forces several blocks
+        for (int i = 0; i < 10; i++) {
+            std::string line = "line " + std::to_string(i) + "\n";
+            writer.write(line);
+            expected += line;
+        }
+        writer.write(std::string(40, 'x'));         // larger than the block
+        expected += std::string(40, 'x');
+    }
+    res = (text.str() == expected);
+    {
+        chash::BufferedWriter writer(bin);
+        chash::write_manifest_header(writer);
+        chash::write_manifest_record(writer, "SHA3-256", "dir/a.txt", bytes.data(), bytes.size());
+        chash::write_manifest_record(writer, "SHAKE128", "", bytes.data(), 2);
+    }
+    std::istringstream in(bin.str());
+    chash::ManifestRecord rec1, rec2, rec3;
+    res = res and chash::read_manifest_header(in)
+              and chash::read_manifest_record(in, rec1)
+              and chash::read_manifest_record(in, rec2)
+              and !chash::read_manifest_record(in, rec3);
+    res = res and rec1.type == "SHA3-256" and rec1.name == "dir/a.txt"
+              and rec1.digest == bytes and rec2.type == "SHAKE128"
+              and rec2.name.empty() and rec2.digest.size() == 2;
+    std::cout << "  buffered writer, binary manifest: " << (res ? "OK.\n" : "FAIL!\n");
+} // end format_test()
+
+//-----------------------------------------------------------------------------
+void stream_test()
+{   // Hashing stream buffers: the digest of what passed through
+    std::cout << "\nTest for hashing stream buffers:\n";
+    std::string msg(10000, '\0');
+    for (size_t i = 0; i < msg.size(); i++)
+        msg[i] = static_cast<char>(i * 17 + 3);
+    chash::SHA3_IUF ref(chash::kSHA3_384);
+    std::vector<chash::byte> expected = ref.get_digest(msg, msg.size() * 8);
+
+    std::istringstream src(msg);
+    chash::SHA3_IUF in_obj(chash::kSHA3_384);
+    chash::HashIStreambuf in_buf(src.rdbuf(), in_obj);
+    std::istream is(&in_buf);
+    std::string copy(msg.size(), '\0');
+    is.read(&copy[0], 1);                       // reads of odd sizes
+    is.read(&copy[1], 4000);
+    is.read(&copy[4001], 5998);
+    is.read(&copy[9999], 100);
+    bool res = (copy == msg);
+    res = res and compare_byte_vectors(expected, in_buf.finalize());
+    std::cout << "  input (read): " << (res ? "OK.\n" : "FAIL!\n");
+
+    std::istringstream src2(msg);
+    chash::SHA3_IUF pump_obj(chash::kSHA3_384);
+    chash::HashIStreambuf pump_buf(src2.rdbuf(), pump_obj);
+    res = (pump_buf.consume_all() == static_cast<std::streamsize>(msg.size()));
+    res = res and compare_byte_vectors(expected, pump_buf.finalize());
+    std::cout << "  input (consume_all): " << (res ? "OK.\n" : "FAIL!\n");
+
+    std::ostringstream dst;
+    chash::SHA3_IUF out_obj(chash::kSHA3_384);
+    chash::HashOStreambuf out_buf(dst.rdbuf(), out_obj);
+    std::ostream os(&out_buf);
+    os.put(msg[0]);
+    os.write(msg.data() + 1, 30);
+    os.write(msg.data() + 31, 9000);            // bypasses the buffer
+    os.write(msg.data() + 9031, msg.size() - 9031);
+    res = compare_byte_vectors(expected, out_buf.finalize());
+    res = res and (dst.str() == msg) and (out_buf.hashed() == msg.size());
+    std::cout << "  output: " << (res ? "OK.\n" : "FAIL!\n");
+} // end stream_test()
+
+//-----------------------------------------------------------------------------
+void multi_buffer_test()
+{
+    std::cout << "\nTest for multi-buffer SHAKE (native width "
+              << chash::kMBWays << "):\n";
+    bool res = check_shake_mb<2>(chash::kSHAKE128) and check_shake_mb<3>(chash::kSHAKE256);
+    std::cout << "  generic kernel: " << (res ? "OK.\n" : "FAIL!\n");
+    res = check_shake_mb<4>(chash::kSHAKE128) and check_shake_mb<4>(chash::kSHAKE256);
+    std::cout << "  4-way: " << (res ? "OK.\n" : "FAIL!\n");
+    res = check_shake_mb<8>(chash::kSHAKE128) and check_shake_mb<8>(chash::kSHAKE256);
+    std::cout << "  8-way: " << (res ? "OK.\n" : "FAIL!\n");
+} // end multi_buffer_test()
+
+//-----------------------------------------------------------------------------
+void multi_message_test()
+{
+    std::cout << "\nTest for multi-message API:\n";
+    std::vector<std::string> msgs;
+    for (size_t i = 0; i < 61; i++)         // from empty to several blocks
+        msgs.push_back(std::string((i * 37) % 700, static_cast<char>(i)));
+    std::vector<const char*> ptrs;
+    std::vector<chash::size_t> lens;
+    for (const auto& msg : msgs) {
+        ptrs.push_back(msg.data());
+        lens.push_back(msg.size());
+    }
+    const chash::KeccParam params[] = { chash::kSHA3_224, chash::kSHA3_512, chash::kSHAKE128 };
+    const chash::Backend backends[] = { chash::Backend::kScalar, chash::Backend::kInterleaved,
+                                        chash::Backend::kAVX2, chash::Backend::kAVX512 };
+    for (chash::Backend backend : backends) {
+        if (!chash::backend_available(backend))
+            continue;
+        bool res = true;
+        for (const auto& param : params) {
+            chash::SHA3_IUF obj(param);
+            chash::size_t bits = (param.dom == chash::Domain::kDomSHAKE) ? 1500 : 0;
+            obj.set_digest_size(bits);
+            std::vector<std::vector<chash::byte>> digests(msgs.size());
+            std::vector<chash::byte*> outs;
+            for (size_t i = 0; i < msgs.size(); i++) {
+                digests[i].resize(200);
+                outs.push_back(digests[i].data());
+            }
+            chash::hash_many(param, ptrs.data(), lens.data(), outs.data(),
+                             msgs.size(), bits, backend);
+            for (size_t i = 0; i < msgs.size(); i++) {
+                std::vector<chash::byte> ref = obj.get_digest(msgs[i], msgs[i].size() * 8);
+                digests[i].resize(ref.size());
+                res = res and compare_byte_vectors(ref, std::move(digests[i]));
+            }
+        }
+        std::cout << "  backend " << chash::backend_name(backend) << ": "
+                  << (res ? "OK.\n" : "FAIL!\n");
+    }
+} // end multi_message_test()
+
+//-----------------------------------------------------------------------------
+template<class OneBlockT, size_t kOut = OneBlockT::kDigest8>
+bool check_iterate(chash::SHA3_IUF& obj)
+{   // 50 steps of the chain against get_digest() of the previous output
+    std::string seed(kOut, '\x3C'), chain = seed;
+    for (int i = 0; i < 50; i++) {
+        std::vector<chash::byte> d = obj.get_digest(chain, chain.size() * 8);
+        chain.assign(d.begin(), d.end());
+    }
+    chash::byte out[kOut];
+    OneBlockT::template iterate<kOut>(reinterpret_cast<const chash::byte*>(seed.data()), 50, out);
+    return (std::string(reinterpret_cast<char*>(out), kOut) == chain);
+} // end check_iterate(...)
+
+//-----------------------------------------------------------------------------
+void iterate_test()
+{   // Hash chains: one chain by OneBlock::iterate(), many chains in
+    // lockstep by iterate_many(); SHA3-256 Monte Carlo checkpoints
+    std::cout << "\nTest for hash chains:\n";
+    chash::SHA3_IUF obj(chash::kSHA3_224);
+    bool res = check_iterate<chash::OneBlockSHA3_224>(obj);
+    obj.setup(chash::kSHA3_256);
+    res = res and check_iterate<chash::OneBlockSHA3_256>(obj);
+    obj.setup(chash::kSHA3_384);
+    res = res and check_iterate<chash::OneBlockSHA3_384>(obj);
+    obj.setup(chash::kSHA3_512);
+    res = res and check_iterate<chash::OneBlockSHA3_512>(obj);
+    obj.setup(chash::kSHAKE128);
+    obj.set_digest_size(20 * 8);
+    res = res and check_iterate<chash::OneBlockSHAKE128, 20>(obj);
+    obj.setup(chash::kSHAKE256);
+    obj.set_digest_size(32 * 8);
+    res = res and check_iterate<chash::OneBlockSHAKE256, 32>(obj);
+    std::cout << "  OneBlock::iterate: " << (res ? "OK.\n" : "FAIL!\n");
+
+    // SHA3_256Monte.rsp: Seed, COUNT = 0 and COUNT = 1 (1000 steps each)
+    const std::string mc[] = {
+        "aa64f7245e2177c654eb4de360da8761a516fdc7578c3498c5e582e096b8730c",
+        "225cbac2be6f329d94228c5360a1c177bc495a761c442a1771b1d18555c309a5",
+        "96d364a1b1ced3dbbce6380093fb1ac77221abcee30faf16546ffad8fe1eef8c" };
+    std::vector<std::vector<chash::byte>> ckpt;
+    for (const auto& hex : mc) {
+        ckpt.emplace_back();
+        for (size_t i = 0; i < hex.size(); i += 2)
+            ckpt.back().push_back(static_cast<chash::byte>(std::stoi(hex.substr(i, 2), nullptr, 16)));
+    }
+    std::vector<chash::byte> out(32);
+    chash::OneBlockSHA3_256::iterate(ckpt[0].data(), 1000, out.data());
+    res = (out == ckpt[1]);
+    chash::OneBlockSHA3_256::iterate(ckpt[1].data(), 1000, out.data());
+    res = res and out == ckpt[2];
+    std::cout << "  Monte Carlo (SHA3-256): " << (res ? "OK.\n" : "FAIL!\n");
+
+    // 13 chains: the Monte Carlo ones and chains of different seeds
+    const chash::KeccParam params[] = { chash::kSHA3_256, chash::kSHA3_224, chash::kSHAKE128 };
+    const chash::Backend backends[] = { chash::Backend::kScalar, chash::Backend::kInterleaved,
+                                        chash::Backend::kAVX2, chash::Backend::kAVX512 };
+    for (chash::Backend backend : backends) {
+        if (!chash::backend_available(backend))
+            continue;
+        res = true;
+        for (const auto& param : params) {
+            const bool shake = (param.dom == chash::Domain::kDomSHAKE);
+            const size_t len = shake ? 20 : static_cast<size_t>(param.hash_size) / 8;
+            std::vector<std::vector<chash::byte>> seeds(13), outs(13);
+            std::vector<const chash::byte*> in;
+            std::vector<chash::byte*> res_ptrs;
+            for (size_t k = 0; k < seeds.size(); k++) {
+                seeds[k] = (k < 2 and !shake and len == 32) ? ckpt[k] :
+                           std::vector<chash::byte>(len, static_cast<chash::byte>(k));
+                outs[k].resize(len);
+                in.push_back(seeds[k].data());
+                res_ptrs.push_back(outs[k].data());
+            }
+            res = res and chash::iterate_many(param, in.data(), res_ptrs.data(),
+                                              seeds.size(), 1000, len, backend);
+            for (size_t k = 0; k < seeds.size(); k++) {
+                std::vector<chash::byte> ref(len);
+                if (shake)
+                    chash::OneBlockSHAKE128::iterate<20>(seeds[k].data(), 1000, ref.data());
+                else if (32 == len)
+                    chash::OneBlockSHA3_256::iterate(seeds[k].data(), 1000, ref.data());
+                else
+                    chash::OneBlockSHA3_224::iterate(seeds[k].data(), 1000, ref.data());
+                res = res and outs[k] == ref;
+            }
+            if (!shake and len == 32)
+                res = res and outs[0] == ckpt[1] and outs[1] == ckpt[2];
+        }
+        // the chain value must fit into one block
+        chash::byte dummy[200] = {};
+        const chash::byte* seed = dummy;
+        chash::byte* dst = dummy;
+        res = res and !chash::iterate_many(chash::kSHAKE256, &seed, &dst, 1, 1, 136, backend);
+        std::cout << "  iterate_many, backend " << chash::backend_name(backend) << ": "
+                  << (res ? "OK.\n" : "FAIL!\n");
+    }
+} // end iterate_test()
+
+//-----------------------------------------------------------------------------
+void cdc_test()
+{   // Content-defined chunking: records cover the stream, digests are right,
+    // boundaries do not depend on the feeding and survive an insertion
+    std::cout << "\nTest for content-defined chunking:\n";
+    std::string data(3000000, '\0');
+    chash::int_t x = 12345;
+    for (auto& c : data) {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        c = static_cast<char>(x >> 56);
+    }
+    auto chunk = [](const std::string& msg, size_t piece) {
+        std::vector<chash::ChunkRecord> recs;
+        std::vector<std::vector<chash::byte>> digests;
+        chash::ChunkPipeline pipe([&](const chash::ChunkRecord& rec) {
+            recs.push_back(rec);
+            digests.emplace_back(rec.digest, rec.digest + 32);
+        });
+        for (size_t pos = 0; pos < msg.size(); pos += piece)
+            pipe.feed(msg.data() + pos, std::min<size_t>(piece, msg.size() - pos));
+        pipe.finish();
+        for (size_t i = 0; i < recs.size(); i++)
+            recs[i].digest = digests[i].data();
+        return (std::make_pair(recs, digests));
+    };
+    auto whole = chunk(data, data.size());
+    auto pieces = chunk(data, 1000);
+    bool res = !whole.first.empty() and (whole.first.size() == pieces.first.size());
+    chash::SHA3_IUF obj(chash::kSHA3_256);
+    uint64_t offset = 0;
+    for (size_t i = 0; res and i < whole.first.size(); i++) {
+        const auto& rec = whole.first[i];
+        res = (rec.offset == offset) and (pieces.first[i].offset == offset)
+              and (rec.length <= 65536) and (whole.second[i] == pieces.second[i]);
+        std::vector<chash::byte> d = obj.get_digest(data.substr(rec.offset, rec.length),
+                                                    rec.length * 8);
+        res = res and (d == whole.second[i]);
+        offset += rec.length;
+    }
+    res = res and (offset == data.size());
+    std::cout << "  records and digests: " << (res ? "OK.\n" : "FAIL!\n");
+
+    auto shifted = chunk("#" + data, 4096);
+    size_t common = 0;
+    for (const auto& d : shifted.second)
+        common += std::count(whole.second.begin(), whole.second.end(), d);
+    res = (common + 2 >= whole.second.size());
+    std::cout << "  shift resistance (" << common << " of " << whole.second.size()
+              << " chunks reused): " << (res ? "OK.\n" : "FAIL!\n");
+} // end cdc_test()
+
+//-----------------------------------------------------------------------------
+void merkle_test()
+{
+    std::cout << "\nTest for Merkle tree (SHA3-256):\n";
+    chash::SHA3_IUF obj(chash::kSHA3_256);
+    bool res = true;
+    for (size_t len = 0; len < 300; len++) {   // leaf hash vs. generic path
+        std::string msg(len, static_cast<char>(len));
+        std::string prefixed = '\0' + msg;
+        std::vector<chash::byte> ref = obj.get_digest(prefixed, prefixed.size() * 8);
+        chash::Digest256 leaf = chash::MerkleTree::hash_leaf(msg.data(), len);
+        res = res and std::equal(leaf.begin(), leaf.end(), ref.begin());
+    }
+    std::cout << "  leaf hash: " << (res ? "OK.\n" : "FAIL!\n");
+
+    std::vector<std::string> leaves;
+    for (size_t i = 0; i < 20001; i++)
+        leaves.push_back("leaf #" + std::to_string(i));
+    // Reference root: straightforward level by level hashing
+    std::vector<std::vector<chash::byte>> level;
+    for (const auto& leaf : leaves) {
+        std::string prefixed = '\0' + leaf;
+        level.push_back(obj.get_digest(prefixed, prefixed.size() * 8));
+    }
+    while (level.size() > 1) {
+        std::vector<std::vector<chash::byte>> next;
+        for (size_t i = 0; i + 1 < level.size(); i += 2) {
+            std::string node(1, '\x01');
+            node.append(level[i].begin(), level[i].end());
+            node.append(level[i + 1].begin(), level[i + 1].end());
+            next.push_back(obj.get_digest(node, node.size() * 8));
+        }
+        if (level.size() % 2)
+            next.push_back(level.back());
+        level.swap(next);
+    }
+    chash::MerkleTree tree(4);
+    tree.build(leaves);
+    chash::Digest256 root = tree.root();
+    res = std::equal(root.begin(), root.end(), level[0].begin());
+    std::cout << "  build (" << leaves.size() << " leaves): "
+              << (res ? "OK.\n" : "FAIL!\n");
+
+    leaves[12345] = "updated leaf";
+    tree.update(12345, leaves[12345]);
+    chash::MerkleTree rebuilt(1);
+    rebuilt.build(leaves);
+    res = (tree.root() == rebuilt.root()) and (tree.root() != root);
+    std::cout << "  incremental update: " << (res ? "OK.\n" : "FAIL!\n");
+
+    res = true;
+    for (size_t i : {0, 1, 12345, 19999, 20000}) {
+        chash::MerkleProof proof = tree.get_proof(i);
+        chash::Digest256 leaf = chash::MerkleTree::hash_leaf(leaves[i].data(),
+                                                             leaves[i].size());
+        res = res and chash::MerkleTree::verify(tree.root(), leaf, proof);
+        leaf[0] ^= 1;                           // tampered leaf
+        res = res and !chash::MerkleTree::verify(tree.root(), leaf, proof);
+    }
+    std::cout << "  inclusion proofs: " << (res ? "OK.\n" : "FAIL!\n");
+
+    // Second preimage: the children of a node presented as a 64-byte leaf
+    // of a smaller tree must not verify (the genuine node does)
+    chash::MerkleTree small(1);
+    small.build(std::vector<std::string>{"a", "b", "c", "d"});
+    chash::Digest256 a = chash::MerkleTree::hash_leaf("a", 1);
+    chash::Digest256 b = chash::MerkleTree::hash_leaf("b", 1);
+    std::string forged(a.begin(), a.end());
+    forged.append(b.begin(), b.end());
+    chash::MerkleProof fake;
+    fake.index = 0;
+    fake.leaf_count = 2;
+    fake.path.push_back(chash::MerkleTree::hash_node(
+        chash::MerkleTree::hash_leaf("c", 1), chash::MerkleTree::hash_leaf("d", 1)));
+    res = chash::MerkleTree::verify(small.root(), chash::MerkleTree::hash_node(a, b), fake)
+          and !chash::MerkleTree::verify(small.root(),
+                   chash::MerkleTree::hash_leaf(forged.data(), forged.size()), fake);
+    std::cout << "  node as a leaf: " << (res ? "OK.\n" : "FAIL!\n");
+} // end merkle_test()
+
+//-----------------------------------------------------------------------------
+void pool_test()
+{
+    std::cout << "\nTest for hasher pool:\n";
+    const std::string msg = "The quick brown fox jumps over the lazy dog.";
+    chash::SHA3_IUF ref_obj(chash::kSHA3_512);
+    std::vector<chash::byte> ref = ref_obj.get_digest(msg, msg.size() * 8);
+
+    std::atomic<int> failed(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; t++)
+        threads.emplace_back([&] {
+            for (int i = 0; i < 2000; i++) {
+                auto lease = chash::hasher_pool(chash::kSHA3_512).acquire();
+                lease->update(msg);
+                if (!compare_byte_vectors(ref, lease->finalize()))
+                    failed++;
+            }
+        });
+    for (auto& thr : threads)
+        thr.join();
+    std::cout << "  concurrent leases: " << (failed == 0 ? "OK.\n" : "FAIL!\n");
+
+    chash::HasherPool pool(chash::kSHAKE128, 2);
+    {
+        auto a = pool.acquire();
+        auto b = pool.acquire();
+        auto c = pool.acquire();                // from the heap
+        a->set_digest_size(1024);
+        a->update(msg);
+        a->finalize();
+    }
+    bool res = (pool.overflow_count() == 1);
+    auto lease = pool.acquire();                // re-initialized object
+    res = res and (lease->finalize().size() == 16);
+    std::cout << "  re-initialization on return: " << (res ? "OK.\n" : "FAIL!\n");
+} // end pool_test()
+
+//-----------------------------------------------------------------------------
+void compact_ctx_test()
+{
+    std::cout << "\nTest for compact context (" << sizeof(chash::KeccakCtx)
+              << " bytes):\n";
+    const chash::KeccParam params[] = { chash::kSHA3_224, chash::kSHA3_256,
+        chash::kSHA3_384, chash::kSHA3_512, chash::kSHAKE128, chash::kSHAKE256 };
+    chash::CtxArena arena(16);
+    std::vector<chash::KeccakCtx*> streams;
+    for (int i = 0; i < 60; i++) {
+        streams.push_back(arena.allocate(params[i % 6]));
+        streams.back()->set_digest_size(1000 + i);  // SHAKE only
+    }
+    std::vector<std::string> data(streams.size());
+    for (int round = 0; round < 50; round++)        // round-robin over streams
+        for (size_t i = 0; i < streams.size(); i++) {
+            std::string chunk((round * 7 + i) % 97, static_cast<char>(round + i));
+            streams[i]->update(chunk.data(), chunk.size());
+            data[i] += chunk;
+        }
+    bool res = true;
+    for (size_t i = 0; i < streams.size(); i++) {
+        chash::SHA3_IUF obj(params[i % 6]);
+        obj.set_digest_size(1000 + i);
+        obj.update(data[i]);
+        std::vector<chash::byte> ref = obj.finalize();
+        std::vector<chash::byte> digest(streams[i]->digest_size());
+        streams[i]->finalize(digest.data());
+        res = res and compare_byte_vectors(ref, std::move(digest));
+        res = res and (reinterpret_cast<std::uintptr_t>(streams[i]) % 16 == 0);
+        arena.release(streams[i]);
+    }
+    std::cout << "  interleaved streams: " << (res ? "OK.\n" : "FAIL!\n");
+    chash::KeccakCtx* arr = arena.allocate_array(100, chash::kSHA3_256);
+    res = (reinterpret_cast<std::uintptr_t>(arr) % chash::CtxArena::kAlign == 0)
+          and (arena.allocate(chash::kSHA3_256) == streams.back());
+    std::cout << "  slab alignment and reuse: " << (res ? "OK.\n" : "FAIL!\n");
+} // end compact_ctx_test()
+
+//-----------------------------------------------------------------------------
+#if __cplusplus >= 202002L and (defined(__unix__) || defined(__APPLE__))
+chash::Task<bool> small_chunks_inline(chash::AsyncHasher& hasher, std::string str)
+{   // small chunks must complete without suspension (on the same thread)
+    std::thread::id id = std::this_thread::get_id();
+    for (size_t i = 0; i < str.size(); i += 10)
+        co_await hasher.update(str.data() + i, std::min<size_t>(10, str.size() - i));
+    co_return (id == std::this_thread::get_id());
+} // end small_chunks_inline(...)
+
+//-----------------------------------------------------------------------------
+void async_test()
+{
+    std::cout << "\nTest for coroutine-based hashing:\n";
+    chash::WorkerPool pool(2);
+    const std::string str = "The quick brown fox jumps over the lazy dog.";
+    chash::SHA3_IUF obj(chash::kSHA3_256);
+    chash::AsyncHasher hasher(obj, pool);
+    bool res = small_chunks_inline(hasher, str).get();
+    chash::SHA3_IUF ref(chash::kSHA3_256);
+    std::vector<chash::byte> digest = hasher.finalize();
+    res = res and compare_byte_vectors(digest, ref.get_digest(str, str.size() * 8));
+    std::cout << "  inline small chunks: " << (res ? "OK.\n" : "FAIL!\n");
+
+    char name[] = "/tmp/sha3_async_XXXXXX";
+    int fd = mkstemp(name);
+    std::string data(5 * 1024 * 1024 + 123, 0);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = static_cast<char>(i * 31 + (i >> 12));
+    res = (fd >= 0) and (write(fd, data.data(), data.size()) == long(data.size()));
+    if (res) {
+        lseek(fd, 0, SEEK_SET);
+        chash::SHA3_IUF file_obj(chash::kSHA3_512);
+        digest = chash::hash_fd(fd, file_obj, pool, 256 * 1024).get();
+        ref.setup(chash::kSHA3_512);
+        res = compare_byte_vectors(digest, ref.get_digest(data, data.size() * 8));
+    }
+    if (fd >= 0) {
+        close(fd);
+        unlink(name);
+    }
+    std::cout << "  file descriptor source: " << (res ? "OK.\n" : "FAIL!\n");
+} // end async_test()
+#endif
+
 //==============================================================================
 int main(int, char* [])
 {
 	std::cout << "Check connection...\n";
 	// ----------------------------------
 	sha3_self_test();
+	one_block_test();
+	constexpr_test();
+	absorb_blocks_test();
+	scatter_gather_test();
+	midstate_test();
+	duplex_test();
+	drbg_test();
+	format_test();
+	stream_test();
+	multi_buffer_test();
+	multi_message_test();
+	iterate_test();
+	cdc_test();
+	merkle_test();
+	pool_test();
+	compact_ctx_test();
+#if __cplusplus >= 202002L and (defined(__unix__) || defined(__APPLE__))
+	async_test();
+#endif
 	// -----------------------------------
 	std::cout << "\nEnd.\n";
 	return(0);
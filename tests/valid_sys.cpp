@@ -7,42 +7,169 @@
  *
  *****************************************************************************/
 
-#include "sha3_ec.h"
+#include "sha3_mb.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <filesystem>
+#include <future>
+#include <iomanip>
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <sstream>
+#include <thread>
 #include <vector>
 #include <regex>
 
 //-----------------------------------------------------------------------------
 using dgst_vec = const std::vector<chash::byte>;
 
-void sha3_test(const std::string &dir);
+static const int kBackends = 5;     // number of chash::Backend values
+
+// A byte-oriented vector kept for the hash_many() pass
+struct MBVector {
+    chash::KeccParam    param;
+    chash::size_t       digest_bits;
+    std::string         msg;
+    std::string         ref_hash;   // hex
+    unsigned            line_num;
+};
+
+// Result of one vector file; filled by a worker thread, printed by main()
+struct FileRun {
+    std::string             fname;
+    std::ostringstream      log;            // mismatch messages
+    int                     failed = 0;
+    bool                    known = true;   // file type recognized
+    chash::size_t           bytes = 0;      // message bytes hashed
+    double                  seconds = 0;
+    std::vector<MBVector>   mb;
+    int                     mb_failed[kBackends] = {};
+    double                  mb_seconds[kBackends] = {};
+    chash::size_t           mb_bytes = 0;   // per backend
+};
+
+std::vector<std::string> list_files(const std::string &dir);
+void sha3_test(FileRun &run, const std::vector<chash::Backend> &backends);
 
 //=============================================================================
 int main(int argc, char** argv)
 {
     std::cout << "Check connection...OK\n";
-    
+
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<chash::Backend> backends;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if ("-j" == arg and i + 1 < argc)
+            threads = std::max(1, std::atoi(argv[++i]));
+        else if ("-backend" == arg and i + 1 < argc) {
+            std::string name = argv[++i];
+            bool found = false;
+            for (int b = 1; b < kBackends; b++)
+                if (name == chash::backend_name(static_cast<chash::Backend>(b))) {
+                    backends.push_back(static_cast<chash::Backend>(b));
+                    found = true;
+                }
+            if (!found) {
+                std::cerr << "Unknown backend " << name << std::endl;
+                return (1);
+            }
+        }
+        else {
+            std::cerr << "Usage: valid_sys [-j threads] [-backend name]..." << std::endl;
+            return (1);
+        }
+    }
+    if (backends.empty())               // all the compiled-in backends
+        for (int b = 1; b < kBackends; b++)
+            backends.push_back(static_cast<chash::Backend>(b));
+    backends.erase(std::remove_if(backends.begin(), backends.end(),
+        [](chash::Backend b) {  return (!chash::backend_available(b));  }),
+        backends.end());
+
     std::string dirs[] = {
         "sha3_bit_test_vectors/", "sha3_byte_test_vectors/",
         "shake_bit_test_vectors/", "shake_byte_test_vectors/"
     };
-    
+    std::vector<FileRun> runs;
+    std::vector<size_t> dir_first;      // index of the 1st file of each dir
     for (const auto& dir : dirs) {
-        if (std::filesystem::exists(dir)) {
-            std::cout << "Checking " << dir << std::endl;
-            sha3_test(dir);
-        }
-        else
+        dir_first.push_back(runs.size());
+        if (!std::filesystem::exists(dir)) {
             std::cerr << "Directory " << dir << "not found." << std::endl;
+            continue;
+        }
+        for (const auto& fname : list_files(dir)) {
+            runs.emplace_back();
+            runs.back().fname = fname;
+        }
+    }
+
+    // The files are checked concurrently and printed in order
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::promise<void>> done(runs.size());
+    std::atomic<size_t> next(0);
+    std::vector<std::future<void>> workers;
+    for (unsigned t = 0; t < std::min<size_t>(threads, runs.size()); t++)
+        workers.push_back(std::async(std::launch::async, [&]() {
+            for (size_t i; (i = next++) < runs.size(); ) {
+                sha3_test(runs[i], backends);
+                done[i].set_value();
+            }
+        }));
+
+    int failed = 0;
+    chash::size_t bytes = 0;
+    for (size_t i = 0, d = 0; i < runs.size(); i++) {
+        for (; d < dir_first.size() and dir_first[d] == i; d++)
+            if (std::filesystem::exists(dirs[d]))
+                std::cout << "Checking " << dirs[d] << std::endl;
+        done[i].get_future().wait();
+        const FileRun& run = runs[i];
+        std::cout << "  Processing " << run.fname << run.log.str();
+        if (!run.known)
+            std::cout << "    Unknown file type.\n";
+        else {
+            std::cout << (0 == run.failed ? "    SUCCESS."
+                    : "\n    FAIL (" + std::to_string(run.failed) + " mismatches found).");
+            std::cout << std::fixed << std::setprecision(1) << " ["
+                      << run.seconds * 1e3 << " ms, "
+                      << (run.seconds > 0 ? run.bytes / run.seconds / 1e6 : 0.0)
+                      << " MB/s]" << std::endl;
+        }
+        failed += run.failed;
+        bytes += run.bytes;
+    }
+    for (auto& w : workers)
+        w.get();
+    double elapsed = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Total: " << runs.size() << " files, " << threads << " threads, "
+              << std::fixed << std::setprecision(1) << elapsed * 1e3 << " ms, "
+              << bytes / elapsed / 1e6 << " MB/s\n";
+    for (auto backend : backends) {     // hash_many() pass of the byte vectors
+        int b = static_cast<int>(backend), mb_failed = 0;
+        double seconds = 0;
+        chash::size_t mb_bytes = 0;
+        for (const auto& run : runs) {
+            mb_failed += run.mb_failed[b];
+            seconds += run.mb_seconds[b];
+            mb_bytes += run.mb_bytes;
+        }
+        std::cout << "  hash_many (" << chash::backend_name(backend) << "): "
+                  << (0 == mb_failed ? "SUCCESS" : "FAIL (" +
+                        std::to_string(mb_failed) + " mismatches found)")
+                  << " [" << seconds * 1e3 << " ms, "
+                  << (seconds > 0 ? mb_bytes / seconds / 1e6 : 0.0) << " MB/s]\n";
+        failed += mb_failed;
     }
- 
     std::cout << "The end.\n";
-    return (0);
+    return (failed ? 1 : 0);
 } // end main()
 //=============================================================================
 
@@ -81,37 +208,87 @@ bool cmp_dgst(const dgst_vec &&dgst, const std::string &ref_dgst)
 //----------------------------------------------------------------------
 inline int check_hash(chash::SHA3_IUF *hash_obj, const std::string& msg, 
                chash::size_t msg_len, const std::string &msg_hash, 
-               unsigned line_num, bool byte_oriented)
+               unsigned line_num, bool byte_oriented, FileRun &run)
 {
+    run.bytes += (msg_len + chash::k8Bits - 1) / chash::k8Bits;
     if (byte_oriented) {
         hash_obj->init();
         hash_obj->update(msg.c_str(), msg_len / chash::k8Bits);
         if (!cmp_dgst(hash_obj->finalize(), msg_hash)) {
-            std::cout << "\n    Hash does not match: line " << line_num;
+            run.log << "\n    Hash does not match: line " << line_num;
+            return (1);
+        }
+        // the same vector through the constexpr sponge (at runtime)
+        bool shake = (hash_obj->get_hash_type().find("SHAKE") != std::string::npos);
+        std::vector<chash::byte> dgst(msg_hash.size() / 2);
+        chash::keccak_const(msg.c_str(), msg_len / chash::k8Bits,
+                hash_obj->get_rate() / chash::k8Bits, static_cast<chash::int_t>(
+                shake ? chash::Domain::kDomSHAKE : chash::Domain::kDomSHA3),
+                dgst.data(), dgst.size());
+        if (!cmp_dgst(std::move(dgst), msg_hash)) {
+            run.log << "\n    Hash (constexpr) does not match: line " << line_num;
             return (1);
         }
+        // and later through hash_many() (the capacity gives the parameters)
+        chash::KeccParam param;
+        param.hash_size = static_cast<chash::HashSize>(
+                (chash::kKeccakWidth - hash_obj->get_rate()) / 2);
+        param.dom = shake ? chash::Domain::kDomSHAKE : chash::Domain::kDomSHA3;
+        run.mb.push_back(MBVector{param, msg_hash.size() * 4,
+                msg.substr(0, msg_len / chash::k8Bits), msg_hash, line_num});
     }
     else {
         if (!cmp_dgst(hash_obj->get_digest(msg, msg_len), msg_hash)) {
-            std::cout << "\n    Hash does not match: line " << line_num;
+            run.log << "\n    Hash does not match: line " << line_num;
             return(1);
         }
     }
     return (0);
 } // end check_hash(...)
 
-//-------------------------------------------
-inline void print_checking_result(int failed)
-{
-    std::cout << (0 == failed ? "    SUCCESS."
-            : "\n    FAIL (" + std::to_string(failed) + " mismatches found).")
-              << std::endl;
-} // end print_checking_result(...)
+//---------------------------------------------------------------------------
+void check_hash_many(FileRun &run, const std::vector<chash::Backend> &backends)
+{   // All the byte vectors of a file through hash_many() with each backend,
+    // one call per run of vectors with the same parameters
+    if (run.mb.empty())
+        return;
+    for (const auto& vec : run.mb)
+        run.mb_bytes += vec.msg.size();
+    for (auto backend : backends) {
+        const int b = static_cast<int>(backend);
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::vector<chash::byte>> digests(run.mb.size());
+        for (size_t first = 0, last = 0; first < run.mb.size(); first = last) {
+            const MBVector& head = run.mb[first];
+            std::vector<const char*> msgs;
+            std::vector<chash::size_t> lens;
+            std::vector<chash::byte*> outs;
+            for (last = first; last < run.mb.size() and
+                    run.mb[last].param.hash_size == head.param.hash_size and
+                    run.mb[last].param.dom == head.param.dom and
+                    run.mb[last].digest_bits == head.digest_bits; last++) {
+                digests[last].resize((head.digest_bits + 7) / 8);
+                msgs.push_back(run.mb[last].msg.data());
+                lens.push_back(run.mb[last].msg.size());
+                outs.push_back(digests[last].data());
+            }
+            chash::hash_many(head.param, msgs.data(), lens.data(), outs.data(),
+                    msgs.size(), head.digest_bits, backend);
+        }
+        run.mb_seconds[b] = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+        for (size_t i = 0; i < run.mb.size(); i++)
+            if (!cmp_dgst(std::move(digests[i]), run.mb[i].ref_hash)) {
+                run.log << "\n    hash_many (" << chash::backend_name(backend)
+                        << ") does not match: line " << run.mb[i].line_num;
+                run.mb_failed[b]++;
+            }
+    }
+} // end check_hash_many(...)
 
 //---------------------------------------------------------
-void long_short_msg(std::ifstream &ifs, bool byte_oriented)
+void long_short_msg(std::ifstream &ifs, bool byte_oriented, FileRun &run)
 {
-    int failed = 0;
     chash::SHA3Param param;
     chash::SHA3_IUF hash_obj;
     std::regex len_patt(R"(\[?(L|Len|Outputlen) = (\d+)\]?)");
@@ -151,15 +328,17 @@ void long_short_msg(std::ifstream &ifs, bool byte_oriented)
         else if (std::regex_match(line, matches, hash_patt)) {
             // calculate the hash and compare it with the sample
             msg_hash = matches[2].str();
-            failed += check_hash(&hash_obj, msg, msg_len, msg_hash, line_num, byte_oriented);
+            run.failed += check_hash(&hash_obj, msg, msg_len, msg_hash, line_num,
+                                     byte_oriented, run);
         } // end for block if(regex_match()....)
     } // end for(line...)
-    print_checking_result(failed);
 } // end long_short_msh(...)
 
 //----------------------------------
-void monte_carlo(std::ifstream& ifs)
-{
+void monte_carlo(std::ifstream& ifs, FileRun &run,
+                 const std::vector<chash::Backend> &backends)
+{   // The chain through get_digest(), then all of the checkpoints at once as
+    // independent chains (seed - the previous checkpoint) by iterate_many()
     chash::SHA3Param param;
     chash::SHA3_IUF hash_obj;
     std::regex len_patt(R"(\[L = (\d+)\])");
@@ -167,6 +346,7 @@ void monte_carlo(std::ifstream& ifs)
     std::regex hash_patt(R"(MD = ([A-Fa-f0-9]+))");
     std::string seed;
     std::string md;
+    std::vector<std::string> chain;     // the seed and the checkpoints
     unsigned line_num = 0;
     for (std::string line; std::getline(ifs, line); line_num += 1) {
         if ('#' == line[0] or line.empty())   // skip comments and empty string
@@ -180,38 +360,68 @@ void monte_carlo(std::ifstream& ifs)
         }
         else if (std::regex_match(line, matches, seed_patt)) {  // for "Seed = ..."
             seed = convert_raw_str(matches[1]);
+            chain.assign(1, seed);
             continue;
         }
         else if (std::regex_match(line, matches, hash_patt)) { // for "MD = ..."
             // Start generation. 
             md = matches[1].str();
+            run.bytes += 1000 * seed.size();
             for (int i = 0; i < 1000; i++)
                 hash_obj.get_digest(seed, seed);
             // Checkpoint
             if (seed != convert_raw_str(md)) {
-                std::cout << "\n    Hash does not match: line " << line_num;
-                std::cout << "\n    FAIL." << std::endl;
+                run.log << "\n    Hash does not match: line " << line_num;
+                run.failed = 1;
                 return;
             }
+            chain.push_back(seed);
         } // end for block if(regex_match()....)
     } // end for(line...)
-    std::cout << "    SUCCESS." << std::endl;
+
+    if (chain.size() < 2)
+        return;
+    std::vector<const chash::byte*> seeds;
+    for (size_t i = 0; i + 1 < chain.size(); i++)
+        seeds.push_back(reinterpret_cast<const chash::byte*>(chain[i].data()));
+    for (auto backend : backends) {
+        std::vector<std::string> res(seeds.size(), std::string(chain[0].size(), 0));
+        std::vector<chash::byte*> outs;
+        for (auto& str : res)
+            outs.push_back(reinterpret_cast<chash::byte*>(&str[0]));
+        chash::iterate_many(param, seeds.data(), outs.data(), seeds.size(), 1000, 0, backend);
+        for (size_t i = 0; i < res.size(); i++)
+            if (res[i] != chain[i + 1]) {
+                run.log << "\n    iterate_many (" << chash::backend_name(backend)
+                        << ") does not match: checkpoint " << i;
+                run.failed = 1;
+                break;
+            }
+    }
 } // end monte_carlo(...)
 
 //-------------------------------------------------------
-void monte_carlo_shake(std::ifstream& ifs, bool shake256)
-{
-    chash::SHA3_IUF hash_obj;
-    if (shake256)
-        hash_obj.setup(chash::kSHAKE256);
-    else
-        hash_obj.setup(chash::kSHAKE128);
+void monte_carlo_shake(std::ifstream& ifs, bool shake256, FileRun &run,
+                       const std::vector<chash::Backend> &backends)
+{   // The chain through get_digest(), then all of the checkpoints at once as
+    // independent chains (seed - the previous checkpoint and its output
+    // length) by hash_many(): every step squeezes the maximal length, the
+    // shorter outputs of the other chains are its prefixes
+    const chash::KeccParam param = shake256 ? chash::kSHAKE256 : chash::kSHAKE128;
+    chash::SHA3_IUF hash_obj(param);
 
     unsigned line_num(0);
     std::string msg;
     chash::size_t min_out_len(0), max_out_len(0), 
                   out_len(0), ref_out_len(0), range(0);
     std::string output;
+    std::vector<std::string> starts, checkpoints;
+    std::vector<chash::size_t> start_lens;
+    auto next_len = [&](const std::string& out) {   // from the rightmost 16 bits
+        unsigned right_bits = 0xFFFF & unsigned(out[out.size() - 2]) << 8;
+        right_bits |= chash::byte(out[out.size() - 1]);
+        return (min_out_len + (right_bits % range));
+    };
     std::regex len_patt(R"(Outputlen = (\d+))");
     std::regex msg_patt(R"(Msg = ([A-Fa-f0-9]+))");
     std::regex out_patt(R"(Output = ([A-Fa-f0-9]+))");
@@ -241,30 +451,62 @@ void monte_carlo_shake(std::ifstream& ifs, bool shake256)
         }
         else if (std::regex_match(line, matches, out_patt)) { // for "Output = ..."
             output = matches[1].str();
+            starts.push_back(msg);
+            start_lens.push_back(out_len);
             // Start generation. 
             for (int i = 0; i < 1000; i++) {
                 msg.resize(16, 0);      // 128 leftmost bits of Output[i-1]
                 hash_obj.set_digest_size(out_len * 8);
                 hash_obj.get_digest(msg, msg);
-                unsigned right_bits = 0xFFFF & unsigned(msg[msg.size() - 2]) << 8;
-                right_bits |= chash::byte(msg[msg.size() - 1]);
-                out_len = min_out_len + (right_bits % range);
+                run.bytes += 16 + out_len;
+                out_len = next_len(msg);
             } // end for(i...)
             // Checkpoint
             if (msg != convert_raw_str(output)) {
-                std::cout << "\n    Hash does not match: line " << line_num;
-                std::cout << "\n    FAIL." << std::endl;
+                run.log << "\n    Hash does not match: line " << line_num;
+                run.failed = 1;
                 return;
             }
+            checkpoints.push_back(msg);
         } // end for block if(regex_match()....)
     } // end for(line...)
-    std::cout << "    SUCCESS." << std::endl;
-} // end monte_carlo(...)
+
+    const size_t count = checkpoints.size();
+    if (!count)
+        return;
+    for (auto backend : backends) {
+        std::vector<std::string> cur(starts), res(count, std::string(max_out_len, 0));
+        std::vector<chash::size_t> lens(start_lens);
+        std::vector<const char*> msgs(count);
+        std::vector<chash::size_t> msg_lens(count, 16);
+        std::vector<chash::byte*> outs(count);
+        for (size_t k = 0; k < count; k++)
+            outs[k] = reinterpret_cast<chash::byte*>(&res[k][0]);
+        for (int i = 0; i < 1000; i++) {
+            for (size_t k = 0; k < count; k++) {
+                cur[k].resize(16, 0);
+                msgs[k] = cur[k].data();
+            }
+            chash::hash_many(param, msgs.data(), msg_lens.data(), outs.data(),
+                             count, max_out_len * 8, backend);
+            for (size_t k = 0; k < count; k++) {
+                cur[k].assign(res[k], 0, lens[k]);
+                lens[k] = next_len(cur[k]);
+            }
+        }
+        for (size_t k = 0; k < count; k++)
+            if (cur[k] != checkpoints[k]) {
+                run.log << "\n    hash_many (" << chash::backend_name(backend)
+                        << ") does not match: checkpoint " << k;
+                run.failed = 1;
+                break;
+            }
+    }
+} // end monte_carlo_shake(...)
 
 //----------------------------------------------------------
-void variable_output(std::ifstream& ifs, bool byte_oriented)
+void variable_output(std::ifstream& ifs, bool byte_oriented, FileRun &run)
 {
-    int failed = 0;
     chash::SHA3_IUF hash_obj(chash::kSHAKE128);
     std::regex len_patt(R"(\[?(Input Length|Outputlen) = (\d+)\]?)");
     std::regex msg_patt(R"((Msg) = *)");
@@ -296,51 +538,61 @@ void variable_output(std::ifstream& ifs, bool byte_oriented)
             // calculate the hash and compare it with the sample
             auto pos = line.find('=') + 2;
             msg_hash = line.substr(pos, line.length() - pos);
-            failed += check_hash(&hash_obj, msg, msg.size()*8, msg_hash, line_num, byte_oriented);
+            run.failed += check_hash(&hash_obj, msg, msg.size()*8, msg_hash, line_num,
+                                     byte_oriented, run);
         } // end for block if(regex_match()....)
     } // end for(line...)
-    print_checking_result(failed);
 }  // end variable_output(...)
 
+//-------------------------------------------------------
+std::vector<std::string> list_files(const std::string &dir)
+{   // The vector files of <dir>, sorted by name
+    std::vector<std::string> res;
+    for (const auto &entry : std::filesystem::directory_iterator(dir))
+        res.push_back(entry.path().string());
+    std::sort(res.begin(), res.end());
+    return (res);
+} // end list_files(...)
+
 //---------------------------------------
-void sha3_test(const std::string &dir)
-{
-    bool byte_oriented = (dir.find("byte") != std::string::npos);
-    bool shake_test = (dir.find("shake") != std::string::npos);
-    // Iterate throw files of directory "path"
-    for (const auto &entry : std::filesystem::directory_iterator(dir)) {
-        // trying opening file
-        std::string fname = entry.path().string();
-        std::ifstream ifs(fname);
-        if (!ifs) {
-            std::cerr << "  Error opening file " << fname << std::endl;
-            continue;
-        }
-        std::cout << "  Processing " << fname;
+void sha3_test(FileRun &run, const std::vector<chash::Backend> &backends)
+{   // One vector file (called by the worker threads)
+    const std::string& fname = run.fname;
+    bool byte_oriented = (fname.find("byte") != std::string::npos);
+    bool shake_test = (fname.find("shake") != std::string::npos);
+    auto start = std::chrono::steady_clock::now();
+    // trying opening file
+    std::ifstream ifs(fname);
+    if (!ifs) {
+        run.log << "\n    Error opening file";
+        run.failed = 1;
+        return;
+    }
 
-        // Determine type of file
-        bool short_msg = (fname.find("ShortMsg") != std::string::npos);
-        bool long_msg = (fname.find("LongMsg") != std::string::npos);
-        bool monte = (fname.find("Monte") != std::string::npos);
-        bool var_out = (fname.find("VariableOut") != std::string::npos);
+    // Determine type of file
+    bool short_msg = (fname.find("ShortMsg") != std::string::npos);
+    bool long_msg = (fname.find("LongMsg") != std::string::npos);
+    bool monte = (fname.find("Monte") != std::string::npos);
+    bool var_out = (fname.find("VariableOut") != std::string::npos);
 
-        // Determine SHA3/SHAKE parameters
-        if (short_msg or long_msg)  // SHA3/SHAKE LongMsg / ShortMsg
-            long_short_msg(ifs, byte_oriented);
-        else if (monte) {           // Pseudorandomly generated message test
-            if (shake_test)
-                monte_carlo_shake(ifs, (fname.find("256") != std::string::npos));
-            else
-                monte_carlo(ifs);
-        }
-        else if (var_out)           // for XOFs (Variable Output Length)
-            variable_output(ifs, byte_oriented);
+    // Determine SHA3/SHAKE parameters
+    if (short_msg or long_msg)  // SHA3/SHAKE LongMsg / ShortMsg
+        long_short_msg(ifs, byte_oriented, run);
+    else if (monte) {           // Pseudorandomly generated message test
+        if (shake_test)
+            monte_carlo_shake(ifs, (fname.find("256") != std::string::npos), run,
+                              backends);
         else
-            std::cout << "    Unknown file type.\n";
-        ifs.close();
-    } // end for(entry...)
-
-    return;
-} // end sha3_bit_test(...)
+            monte_carlo(ifs, run, backends);
+    }
+    else if (var_out)           // for XOFs (Variable Output Length)
+        variable_output(ifs, byte_oriented, run);
+    else
+        run.known = false;
+    ifs.close();
+    run.seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+    check_hash_many(run, backends);
+} // end sha3_test(...)
 
 //-----------------------------------------------------------------------------